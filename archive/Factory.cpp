@@ -19,43 +19,42 @@
 #include "Factory.hpp"
 
 #include "com.hpp"
+#include "counters.hpp"
+#include "settings.hpp"
 
+#include "FormatCache.hpp"
 #include "Module.hpp"
 
+#include <chrono>
 #include <filesystem>
+#include <future>
 #include <limits>
+#include <optional>
+#include <vector>
 
 namespace archive
 {
     CLASS_IMPLEMENTATION(Factory,
 public:
     FormatsCollection Formats;
+    std::vector<Module> modules;
     );
 
-    static void LoadModule(Factory::FormatsCollection& formats, const std::filesystem::path& path)
+    static FormatCache::FormatsCollection QueryModule(const std::filesystem::path& path)
     {
         const auto library = Module(path);
         auto formatCount = UINT32(0);
         COM_DO_OR_THROW(library.GetNumberOfFormats(formatCount));
+        auto formats = FormatCache::FormatsCollection();
         for (auto i = UINT32(0); i < formatCount; i++)
         {
-            try
-            {
-                // add all formats for non-existing extensions
-                const auto format = Format(library, i);
-                for (const auto& ext : format.Extensions)
-                {
-                    if (formats.find(ext) == formats.end())
-                    {
-                        formats.insert_or_assign(ext, format);
-                    }
-                }
-            }
+            try { formats.emplace_back(library, i); }
             catch (...) {}
         }
+        return formats;
     }
 
-    static void LoadAllModules(Factory::FormatsCollection& formats, const std::filesystem::path& directory)
+    static void ListAllModules(std::vector<std::filesystem::path>& paths, const std::filesystem::path& directory)
     {
         if (!std::filesystem::is_directory(directory)) { return; } // ensure the argument is a directory
         for (const auto& entry : std::filesystem::directory_iterator(directory))
@@ -63,20 +62,80 @@ namespace archive
             // only load dlls (I can't believe I have to resort to _wcsnicmp in C++)
             const auto& path = entry.path();
             if (entry.is_directory() || _wcsnicmp(path.extension().c_str(), STR(".dll").c_str(), std::numeric_limits<size_t>::max())) { continue; }
-
-            // ignore errors
-            try { LoadModule(formats, path); }
-            catch (...) {}
+            paths.push_back(path);
         }
     }
 
     Factory::Factory() : PIMPL_INIT()
     {
-        // load 7z.dll and all other formats
+        const auto start = std::chrono::steady_clock::now();
+
+        // list 7z.dll and all other modules
         const auto filterDir = utils::get_module_file_path(utils::get_current_module().get()).parent_path();
-        LoadModule(PIMPL_(Formats), filterDir / L"7z.dll");
-        LoadAllModules(PIMPL_(Formats), filterDir / L"codecs"); // in case someone misplaces a DLL or a codec DLL also includes formats
-        LoadAllModules(PIMPL_(Formats), filterDir / L"formats");
+        auto paths = std::vector<std::filesystem::path>{ filterDir / L"7z.dll" };
+        ListAllModules(paths, filterDir / L"codecs"); // in case someone misplaces a DLL or a codec DLL also includes formats
+        ListAllModules(paths, filterDir / L"formats");
+
+        // take unchanged modules from the cache and query all others in parallel (the cache lives next to the modules, so only those who can replace them can write it, usually regsvr32)
+        auto cache = FormatCache(filterDir / L"iFilter4Archives.formats");
+        auto cachedFormats = std::vector<std::optional<FormatCache::FormatsCollection>>(paths.size());
+        auto queriedFormats = std::vector<std::future<FormatCache::FormatsCollection>>(paths.size());
+        for (auto i = size_t(0); i < paths.size(); i++)
+        {
+            try { cachedFormats[i] = cache.Find(paths[i]); }
+            catch (...) {} // query the module instead
+            if (!cachedFormats[i])
+            {
+                queriedFormats[i] = std::async(std::launch::async, QueryModule, paths[i]);
+            }
+        }
+
+        // add all formats for non-existing extensions in module order (errors are only fatal for 7z.dll)
+        auto entries = std::vector<FormatsCollection::entry>();
+        for (auto i = size_t(0); i < paths.size(); i++)
+        {
+            auto formats = FormatCache::FormatsCollection();
+            if (cachedFormats[i])
+            {
+                formats = std::move(*cachedFormats[i]);
+                counters::increment(counters::counter::factory_modules_cached);
+            }
+            else
+            {
+                try
+                {
+                    formats = queriedFormats[i].get();
+                    cache.Store(paths[i], formats);
+                    counters::increment(counters::counter::factory_modules_queried);
+                }
+                catch (...)
+                {
+                    if (i == 0) { throw; }
+                    cache.Store(paths[i], FormatCache::FormatsCollection()); // no formats (e.g. a pure codec module), skipped until it changes
+                    continue;
+                }
+            }
+            if (!formats.empty())
+            {
+                PIMPL_(modules).push_back(formats.front().Library);
+            }
+            for (const auto& format : formats)
+            {
+                for (const auto& ext : format.Extensions)
+                {
+                    entries.emplace_back(ext, format); // the table ignores existing extensions
+                }
+            }
+        }
+        PIMPL_(Formats) = FormatsCollection(std::move(entries));
+
+        // update the cache if necessary (other processes might do the same, so ignore errors)
+        if (cache.IsStale)
+        {
+            try { cache.Save(); }
+            catch (...) {}
+        }
+        counters::increment(counters::counter::factory_startup_microseconds, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
     }
 
     PIMPL_GETTER(Factory, const Factory::FormatsCollection&, Formats);
@@ -87,11 +146,22 @@ namespace archive
         return instance;
     }
 
-    sevenzip::IInArchivePtr Factory::CreateArchiveFromExtension(const std::wstring& extension)
+    sevenzip::IInArchivePtr Factory::CreateArchiveFromExtension(std::wstring_view extension, std::optional<ModuleUsage>& usage, ULONG decoderThreads)
     {
-        const auto& formats = GetInstance().Formats;
-        const auto formatEntry = formats.find(extension);
-        if (formatEntry == formats.end()) { COM_THROW(FILTER_E_UNKNOWNFORMAT); }
-        return formatEntry->second.CreateArchive();
+        const auto& instance = GetInstance();
+
+        // opportunistically release modules that haven't been used for a while
+        const auto idleTime = settings::module_idle_time();
+        if (idleTime > 0)
+        {
+            for (const auto& module : instance.PIMPL_(modules))
+            {
+                module.UnloadIfIdle(std::chrono::seconds(idleTime));
+            }
+        }
+
+        const auto format = instance.Formats.find(extension);
+        if (format == nullptr) { COM_THROW(FILTER_E_UNKNOWNFORMAT); }
+        return format->CreateArchive(usage, decoderThreads);
     }
 }
@@ -18,17 +18,18 @@
 
 #pragma once
 
+#include "extension_table.hpp"
 #include "pimpl.hpp"
 #include "sevenzip.hpp"
 
 #include "Format.hpp"
 
-#include <string>
-#include <unordered_map>
+#include <optional>
+#include <string_view>
 
 namespace archive
 {
-    class Factory; // loads all 7-Zip modules and provides a format lookup based on file extensions
+    class Factory; // knows all 7-Zip modules and provides a format lookup based on file extensions
 
     /******************************************************************************/
 
@@ -37,11 +38,11 @@ namespace archive
     Factory();
 
 public:
-    using FormatsCollection = std::unordered_map<std::wstring, Format>;
+    using FormatsCollection = utils::extension_table<Format>;
 
     PROPERTY_READONLY(const FormatsCollection&, Formats, PIMPL_GETTER_ATTRIB);
 
     static const Factory& GetInstance(); // sadly, there are no static properties
-    static sevenzip::IInArchivePtr CreateArchiveFromExtension(const std::wstring& extension); // extension must be lower-case and dot-prefixed
+    static sevenzip::IInArchivePtr CreateArchiveFromExtension(std::wstring_view extension, std::optional<ModuleUsage>& usage, ULONG decoderThreads); // extension must be dot-prefixed, usage must outlive the archive
     );
 }
@@ -19,6 +19,10 @@
 #include "Format.hpp"
 
 #include "com.hpp"
+#include "settings.hpp"
+
+#include <new>
+#include <string>
 
 namespace archive
 {
@@ -26,12 +30,20 @@ namespace archive
                          PIMPL_CONSTRUCTOR(const Module& library) : Library(library) {}
 public:
     const Module Library;
-    GUID clsid;
+    GUID Clsid;
     std::wstring defaultName;
     std::wstring Name;
     ExtensionsCollection Extensions;
+    SignaturesCollection Signatures;
+    UINT32 SignatureOffset = 0;
     );
 
+    static std::string BinaryFromPropVariant(const PROPVARIANT& propv)
+    {
+        if (propv.vt != VT_BSTR || propv.bstrVal == nullptr) { return std::string(); }
+        return std::string(reinterpret_cast<const char*>(propv.bstrVal), ::SysStringByteLen(propv.bstrVal));
+    }
+
     Format::Format(const Module& library, UINT32 index) : PIMPL_INIT(library)
     {
         auto propv = win32::propvariant();
@@ -45,7 +57,7 @@ namespace archive
         // clsid
         COM_DO_OR_THROW(library.GetFormatProperty(index, sevenzip::HandlerPropertyId::ClassID, propv));
         if (propv.vt != VT_BSTR) { COM_THROW(E_NOT_SET); }
-        std::memcpy(&PIMPL_(clsid), reinterpret_cast<GUID*>(propv.bstrVal), sizeof(GUID)); // alas, GUIDs aren't stored properly
+        std::memcpy(&PIMPL_(Clsid), reinterpret_cast<GUID*>(propv.bstrVal), sizeof(GUID)); // alas, GUIDs aren't stored properly
         propv.clear();
 
         // extensions
@@ -69,17 +81,85 @@ namespace archive
         {
             PIMPL_(Extensions).insert(CHR('.') + exts);
         }
+
+        // signatures (optional, multiple signatures are each prefixed by their length)
+        if (SUCCEEDED(library.GetFormatProperty(index, sevenzip::HandlerPropertyId::MultiSignature, propv)))
+        {
+            const auto multi = BinaryFromPropVariant(propv);
+            for (auto pos = size_t(0); pos < multi.length(); pos += 1 + static_cast<unsigned char>(multi[pos]))
+            {
+                const auto length = static_cast<unsigned char>(multi[pos]);
+                if (length > 0 && pos + 1 + length <= multi.length())
+                {
+                    PIMPL_(Signatures).push_back(multi.substr(pos + 1, length));
+                }
+            }
+        }
+        propv.clear();
+        if (PIMPL_(Signatures).empty() && SUCCEEDED(library.GetFormatProperty(index, sevenzip::HandlerPropertyId::Signature, propv)))
+        {
+            auto single = BinaryFromPropVariant(propv);
+            if (!single.empty())
+            {
+                PIMPL_(Signatures).push_back(std::move(single));
+            }
+        }
+        propv.clear();
+        if (SUCCEEDED(library.GetFormatProperty(index, sevenzip::HandlerPropertyId::SignatureOffset, propv)))
+        {
+            PIMPL_(SignatureOffset) = ::PropVariantToUInt32WithDefault(propv, 0);
+        }
+    }
+
+    Format::Format(const Module& library, const std::wstring& name, const GUID& clsid, const ExtensionsCollection& extensions, const SignaturesCollection& signatures, UINT32 signatureOffset) : PIMPL_INIT(library)
+    {
+        PIMPL_(Name) = name;
+        PIMPL_(Clsid) = clsid;
+        PIMPL_(Extensions) = extensions;
+        PIMPL_(Signatures) = signatures;
+        PIMPL_(SignatureOffset) = signatureOffset;
     }
 
     PIMPL_GETTER(Format, const Module&, Library);
     PIMPL_GETTER(Format, const std::wstring&, Name);
+    PIMPL_GETTER(Format, const GUID&, Clsid);
     PIMPL_GETTER(Format, const Format::ExtensionsCollection&, Extensions);
+    PIMPL_GETTER(Format, const Format::SignaturesCollection&, Signatures);
+    PIMPL_GETTER(Format, UINT32, SignatureOffset);
 
-    sevenzip::IInArchivePtr Format::CreateArchive() const
+    sevenzip::IInArchivePtr Format::CreateArchive(std::optional<ModuleUsage>& usage, ULONG decoderThreads) const
     {
+        usage = PIMPL_(Library).Use();
         auto ptr = sevenzip::IInArchivePtr();
-        COM_DO_OR_THROW(PIMPL_(Library).CreateObject(PIMPL_(clsid), __uuidof(sevenzip::IInArchive), *reinterpret_cast<void**>(&ptr)));
+        COM_DO_OR_THROW(PIMPL_(Library).CreateObject(PIMPL_(Clsid), __uuidof(sevenzip::IInArchive), *reinterpret_cast<void**>(&ptr)));
         if (!ptr) { COM_THROW(E_NOINTERFACE); } // this check is done because we don't blindly trust the result of modules
+
+        // pass the decoder options to handlers that take any (e.g. 7z, xz or zstd), before the archive gets opened
+        auto setProperties = sevenzip::ISetPropertiesPtr();
+        if (SUCCEEDED(ptr->QueryInterface<sevenzip::ISetProperties>(&setProperties)) && setProperties)
+        {
+            // handlers reset all properties on every call, so they have to be passed at once
+            static_assert(sizeof(win32::propvariant) == sizeof(PROPVARIANT)); // passed as an array
+            const wchar_t* names[] = { STR("mt").c_str(), STR("memx").c_str() };
+            win32::propvariant values[2];
+            values[0].vt = VT_UI4;
+            values[0].ulVal = decoderThreads;
+            auto count = UINT32(1);
+            const auto memoryLimit = settings::decoder_memory_limit();
+            if (memoryLimit > 0)
+            {
+                values[1].vt = VT_BSTR;
+                values[1].bstrVal = ::SysAllocString(std::to_wstring(memoryLimit).append(STR("m")).c_str()); // handlers only parse sizes from strings
+                if (values[1].bstrVal == nullptr) { throw std::bad_alloc(); }
+                count++;
+            }
+
+            // handlers reject the whole call if they don't know a single property, so at least keep the thread count then
+            if (FAILED(setProperties->SetProperties(names, values, count)) && count > 1)
+            {
+                setProperties->SetProperties(names, values, 1);
+            }
+        }
         return ptr;
     }
 }
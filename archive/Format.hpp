@@ -23,8 +23,10 @@
 
 #include "Module.hpp"
 
+#include <optional>
 #include <string>
 #include <unordered_set>
+#include <vector>
 
 namespace archive
 {
@@ -35,13 +37,18 @@ namespace archive
     CLASS_DECLARATION(Format,
 public:
     using ExtensionsCollection = std::unordered_set<std::wstring>;
+    using SignaturesCollection = std::vector<std::string>; // binary
 
-    Format(const Module& library, UINT32 index);
+    Format(const Module& library, UINT32 index); // queries the module
+    Format(const Module& library, const std::wstring& name, const GUID& clsid, const ExtensionsCollection& extensions, const SignaturesCollection& signatures, UINT32 signatureOffset); // previously queried values
 
     PROPERTY_READONLY(const Module&, Library, PIMPL_GETTER_ATTRIB);
     PROPERTY_READONLY(const std::wstring&, Name, PIMPL_GETTER_ATTRIB);
+    PROPERTY_READONLY(const GUID&, Clsid, PIMPL_GETTER_ATTRIB);
     PROPERTY_READONLY(const ExtensionsCollection&, Extensions, PIMPL_GETTER_ATTRIB); // guaranteed to be lower-case
+    PROPERTY_READONLY(const SignaturesCollection&, Signatures, PIMPL_GETTER_ATTRIB);
+    PROPERTY_READONLY(UINT32, SignatureOffset, PIMPL_GETTER_ATTRIB);
 
-    sevenzip::IInArchivePtr CreateArchive() const;
+    sevenzip::IInArchivePtr CreateArchive(std::optional<ModuleUsage>& usage, ULONG decoderThreads) const; // usage must outlive the archive
     );
 }
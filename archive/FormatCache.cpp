@@ -0,0 +1,281 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FormatCache.hpp"
+
+#include "win32.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cwctype>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+namespace archive
+{
+    constexpr static const auto CacheMagic = UINT32(0x46413449); // "I4AF"
+    constexpr static const auto CacheVersion = UINT32(1);
+    constexpr static const auto MaximumCachedLength = UINT32(0x10000); // protects against corrupted files
+
+    struct CachedFormat
+    {
+        std::wstring Name;
+        GUID Clsid;
+        Format::ExtensionsCollection Extensions;
+        Format::SignaturesCollection Signatures;
+        UINT32 SignatureOffset;
+    };
+
+    struct CachedModule
+    {
+        ULONGLONG Size;
+        LONGLONG LastWriteTime;
+        std::vector<CachedFormat> Formats;
+        bool IsUsed = false;
+    };
+
+    /******************************************************************************/
+
+    class CacheReader
+    {
+    private:
+        std::ifstream _stream;
+
+    public:
+        explicit CacheReader(const std::filesystem::path& path) : _stream(path, std::ios::binary)
+        {
+            _stream.exceptions(std::ios::failbit | std::ios::badbit | std::ios::eofbit);
+        }
+
+        template <typename T>
+        T Read()
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            auto value = T();
+            _stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+            return value;
+        }
+
+        UINT32 ReadLength()
+        {
+            const auto length = Read<UINT32>();
+            if (length > MaximumCachedLength) { throw std::length_error("length"); }
+            return length;
+        }
+
+        template <typename String>
+        String ReadString()
+        {
+            auto value = String(ReadLength(), typename String::value_type());
+            _stream.read(reinterpret_cast<char*>(value.data()), value.length() * sizeof(typename String::value_type));
+            return value;
+        }
+    };
+
+    class CacheWriter
+    {
+    private:
+        std::ofstream _stream;
+
+    public:
+        explicit CacheWriter(const std::filesystem::path& path) : _stream(path, std::ios::binary | std::ios::trunc)
+        {
+            _stream.exceptions(std::ios::failbit | std::ios::badbit);
+        }
+
+        template <typename T>
+        void Write(const T& value)
+        {
+            static_assert(std::is_trivially_copyable_v<T>);
+            _stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+        }
+
+        template <typename String>
+        void WriteString(const String& value)
+        {
+            Write(static_cast<UINT32>(value.length()));
+            _stream.write(reinterpret_cast<const char*>(value.data()), value.length() * sizeof(typename String::value_type));
+        }
+
+        void Close() { _stream.close(); }
+    };
+
+    /******************************************************************************/
+
+    static void ValidateModulePath(const std::filesystem::path& modulePath, const std::filesystem::path& cachePath)
+    {
+        // only modules below the cache's directory can be looked up anyway, so anything else means the file wasn't written by us
+        const auto relativePath = modulePath.lexically_relative(cachePath.parent_path());
+        if (!modulePath.is_absolute() || relativePath.empty() || *relativePath.begin() == L"..") { throw std::invalid_argument("modulePath"); }
+    }
+
+    static void ValidateExtension(const std::wstring& extension)
+    {
+        // the same requirements as for extensions reported by the modules (dot-prefixed and lower-case)
+        if (extension.length() < 2 || extension[0] != L'.' || extension.find(L' ') != std::wstring::npos) { throw std::invalid_argument("extension"); }
+        if (std::any_of(extension.begin(), extension.end(), [](wchar_t c) { return std::towlower(c) != c; })) { throw std::invalid_argument("extension"); }
+    }
+
+    static std::optional<std::pair<ULONGLONG, LONGLONG>> GetModuleStamp(const std::filesystem::path& modulePath) noexcept
+    {
+        auto error = std::error_code();
+        const auto size = std::filesystem::file_size(modulePath, error);
+        if (error) { return std::nullopt; }
+        const auto lastWriteTime = std::filesystem::last_write_time(modulePath, error);
+        if (error) { return std::nullopt; }
+        return std::make_pair(static_cast<ULONGLONG>(size), static_cast<LONGLONG>(lastWriteTime.time_since_epoch().count()));
+    }
+
+    /******************************************************************************/
+
+    CLASS_IMPLEMENTATION(FormatCache,
+                         PIMPL_CONSTRUCTOR(const std::filesystem::path& path) : path(path) {}
+public:
+    const std::filesystem::path path;
+    std::map<std::filesystem::path, CachedModule> modules;
+    bool isStale = false;
+
+    void Read()
+    {
+        auto reader = CacheReader(path);
+        if (reader.Read<UINT32>() != CacheMagic || reader.Read<UINT32>() != CacheVersion) { return; }
+        for (auto moduleCount = reader.ReadLength(); moduleCount > 0; moduleCount--)
+        {
+            const auto modulePath = std::filesystem::path(reader.ReadString<std::wstring>());
+            ValidateModulePath(modulePath, path);
+            auto module = CachedModule();
+            module.Size = reader.Read<ULONGLONG>();
+            module.LastWriteTime = reader.Read<LONGLONG>();
+            for (auto formatCount = reader.ReadLength(); formatCount > 0; formatCount--)
+            {
+                auto& format = module.Formats.emplace_back();
+                format.Name = reader.ReadString<std::wstring>();
+                format.Clsid = reader.Read<GUID>();
+                for (auto extensionCount = reader.ReadLength(); extensionCount > 0; extensionCount--)
+                {
+                    const auto& extension = *format.Extensions.insert(reader.ReadString<std::wstring>()).first;
+                    ValidateExtension(extension);
+                }
+                for (auto signatureCount = reader.ReadLength(); signatureCount > 0; signatureCount--)
+                {
+                    format.Signatures.push_back(reader.ReadString<std::string>());
+                }
+                format.SignatureOffset = reader.Read<UINT32>();
+            }
+            modules.insert_or_assign(modulePath, std::move(module));
+        }
+    }
+    );
+
+    FormatCache::FormatCache(const std::filesystem::path& path) : PIMPL_INIT(path)
+    {
+        try { PIMPL_(Read)(); }
+        catch (...) { PIMPL_(modules).clear(); } // missing, outdated, corrupted or invalid, start over
+    }
+
+    bool FormatCache::GetIsStale() const noexcept
+    {
+        if (PIMPL_(isStale)) { return true; }
+        for (const auto& module : PIMPL_(modules))
+        {
+            if (!module.second.IsUsed) { return true; } // the module got removed
+        }
+        return false;
+    }
+
+    std::optional<FormatCache::FormatsCollection> FormatCache::Find(const std::filesystem::path& modulePath)
+    {
+        // check if the module is cached and unchanged
+        const auto entry = PIMPL_(modules).find(modulePath);
+        if (entry == PIMPL_(modules).end()) { return std::nullopt; }
+        const auto stamp = GetModuleStamp(modulePath);
+        if (!stamp || stamp->first != entry->second.Size || stamp->second != entry->second.LastWriteTime) { return std::nullopt; }
+
+        // recreate the formats
+        const auto library = Module(modulePath);
+        auto formats = FormatsCollection();
+        formats.reserve(entry->second.Formats.size());
+        for (const auto& format : entry->second.Formats)
+        {
+            formats.emplace_back(library, format.Name, format.Clsid, format.Extensions, format.Signatures, format.SignatureOffset);
+        }
+        entry->second.IsUsed = true;
+        return formats;
+    }
+
+    void FormatCache::Store(const std::filesystem::path& modulePath, const FormatsCollection& formats)
+    {
+        const auto stamp = GetModuleStamp(modulePath);
+        if (!stamp) { return; } // better not cache it at all
+        auto module = CachedModule();
+        module.Size = stamp->first;
+        module.LastWriteTime = stamp->second;
+        module.IsUsed = true;
+        for (const auto& format : formats)
+        {
+            module.Formats.push_back({ format.Name, format.Clsid, format.Extensions, format.Signatures, format.SignatureOffset });
+        }
+        PIMPL_(modules).insert_or_assign(modulePath, std::move(module));
+        PIMPL_(isStale) = true;
+    }
+
+    void FormatCache::Save() const
+    {
+        // write to a temporary file first, other processes might read the cache concurrently
+        auto tempPath = PIMPL_(path);
+        tempPath.replace_filename(utils::get_temp_file_name());
+        try
+        {
+            auto writer = CacheWriter(tempPath);
+            writer.Write(CacheMagic);
+            writer.Write(CacheVersion);
+            auto moduleCount = UINT32(0);
+            for (const auto& module : PIMPL_(modules)) { if (module.second.IsUsed) { moduleCount++; } }
+            writer.Write(moduleCount);
+            for (const auto& module : PIMPL_(modules))
+            {
+                if (!module.second.IsUsed) { continue; }
+                writer.WriteString(module.first.native());
+                writer.Write(module.second.Size);
+                writer.Write(module.second.LastWriteTime);
+                writer.Write(static_cast<UINT32>(module.second.Formats.size()));
+                for (const auto& format : module.second.Formats)
+                {
+                    writer.WriteString(format.Name);
+                    writer.Write(format.Clsid);
+                    writer.Write(static_cast<UINT32>(format.Extensions.size()));
+                    for (const auto& extension : format.Extensions) { writer.WriteString(extension); }
+                    writer.Write(static_cast<UINT32>(format.Signatures.size()));
+                    for (const auto& signature : format.Signatures) { writer.WriteString(signature); }
+                    writer.Write(format.SignatureOffset);
+                }
+            }
+            writer.Close();
+            std::filesystem::rename(tempPath, PIMPL_(path));
+        }
+        catch (...)
+        {
+            auto error = std::error_code();
+            std::filesystem::remove(tempPath, error);
+            throw;
+        }
+    }
+}
@@ -0,0 +1,48 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pimpl.hpp"
+
+#include "Format.hpp"
+#include "Module.hpp"
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace archive
+{
+    class FormatCache; // persists the formats of all modules, so that unchanged modules don't have to be queried again
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION(FormatCache,
+public:
+    using FormatsCollection = std::vector<Format>;
+
+    explicit FormatCache(const std::filesystem::path& path); // reads the cache file, a missing or invalid file results in an empty cache
+
+    PROPERTY_READONLY(bool, IsStale, const noexcept); // true if any module got stored or a cached one wasn't looked up
+
+    std::optional<FormatsCollection> Find(const std::filesystem::path& modulePath); // only returns formats if the module didn't change since it got stored
+    void Store(const std::filesystem::path& modulePath, const FormatsCollection& formats);
+    void Save() const; // replaces the cache file with all found and stored modules
+    );
+}
@@ -18,42 +18,119 @@
 
 #include "Module.hpp"
 
+#include "com.hpp"
+#include "counters.hpp"
 #include "win32.hpp"
 
+#include <mutex>
+
 namespace archive
 {
     CLASS_IMPLEMENTATION(Module,
 public:
     std::filesystem::path Path;
-    win32::unique_library_ptr modulePtr;
-    sevenzip::Func_CreateObject createObjectFunc;
-    sevenzip::Func_GetNumberOfFormats getNumberOfFormatsFunc;
-    sevenzip::Func_GetHandlerProperty2 getFormatPropertyFunc;
+    std::mutex m;
+    win32::unique_library_ptr modulePtr; // only set while loaded
+    sevenzip::Func_CreateObject createObjectFunc = nullptr;
+    sevenzip::Func_GetNumberOfFormats getNumberOfFormatsFunc = nullptr;
+    sevenzip::Func_GetHandlerProperty2 getFormatPropertyFunc = nullptr;
+    size_t usageCount = 0;
+    std::chrono::steady_clock::time_point lastUsed;
+
+    // called with m locked
+    void EnsureLoaded()
+    {
+        lastUsed = std::chrono::steady_clock::now();
+        if (modulePtr) { return; }
+        auto ptr = utils::load_module(Path);
+        WIN32_DO_OR_THROW(createObjectFunc = reinterpret_cast<sevenzip::Func_CreateObject>(::GetProcAddress(ptr.get(), "CreateObject")));
+        WIN32_DO_OR_THROW(getNumberOfFormatsFunc = reinterpret_cast<sevenzip::Func_GetNumberOfFormats>(::GetProcAddress(ptr.get(), "GetNumberOfFormats")));
+        WIN32_DO_OR_THROW(getFormatPropertyFunc = reinterpret_cast<sevenzip::Func_GetHandlerProperty2>(::GetProcAddress(ptr.get(), "GetHandlerProperty2")));
+        modulePtr = std::move(ptr);
+        counters::increment(counters::counter::module_loads);
+        counters::increment(counters::counter::modules_resident);
+    }
     );
 
     Module::Module(const std::filesystem::path& path) : PIMPL_INIT()
     {
         PIMPL_(Path) = path;
-        PIMPL_(modulePtr) = utils::load_module(path);
-        WIN32_DO_OR_THROW(PIMPL_(createObjectFunc) = reinterpret_cast<sevenzip::Func_CreateObject>(::GetProcAddress(PIMPL_(modulePtr).get(), "CreateObject")));
-        WIN32_DO_OR_THROW(PIMPL_(getNumberOfFormatsFunc) = reinterpret_cast<sevenzip::Func_GetNumberOfFormats>(::GetProcAddress(PIMPL_(modulePtr).get(), "GetNumberOfFormats")));
-        WIN32_DO_OR_THROW(PIMPL_(getFormatPropertyFunc) = reinterpret_cast<sevenzip::Func_GetHandlerProperty2>(::GetProcAddress(PIMPL_(modulePtr).get(), "GetHandlerProperty2")));
     }
 
     PIMPL_GETTER(Module, const std::filesystem::path&, Path);
 
     HRESULT Module::CreateObject(REFCLSID rclsid, REFIID riid, void*& ppv) const noexcept
     {
+        COM_NOTHROW_BEGIN;
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(EnsureLoaded)();
         return PIMPL_(createObjectFunc)(&rclsid, &riid, &ppv);
+        PIMPL_LOCK_END;
+        COM_NOTHROW_END;
     }
 
     HRESULT Module::GetNumberOfFormats(UINT32& count) const noexcept
     {
+        COM_NOTHROW_BEGIN;
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(EnsureLoaded)();
         return PIMPL_(getNumberOfFormatsFunc)(&count);
+        PIMPL_LOCK_END;
+        COM_NOTHROW_END;
     }
 
     HRESULT Module::GetFormatProperty(UINT32 index, sevenzip::HandlerPropertyId propId, PROPVARIANT& value) const noexcept
     {
+        COM_NOTHROW_BEGIN;
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(EnsureLoaded)();
         return PIMPL_(getFormatPropertyFunc)(index, propId, &value);
+        PIMPL_LOCK_END;
+        COM_NOTHROW_END;
     }
+
+    ModuleUsage Module::Use() const
+    {
+        return ModuleUsage(*this);
+    }
+
+    bool Module::UnloadIfIdle(std::chrono::steady_clock::duration idleTime) const noexcept
+    {
+        PIMPL_LOCK_BEGIN(m);
+        if (!PIMPL_(modulePtr) || PIMPL_(usageCount) > 0 || std::chrono::steady_clock::now() - PIMPL_(lastUsed) < idleTime) { return false; }
+        PIMPL_(modulePtr).reset();
+        PIMPL_(createObjectFunc) = nullptr;
+        PIMPL_(getNumberOfFormatsFunc) = nullptr;
+        PIMPL_(getFormatPropertyFunc) = nullptr;
+        PIMPL_LOCK_END;
+        counters::decrement(counters::counter::modules_resident);
+        return true;
+    }
+
+    void Module::AddUsage() const
+    {
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(EnsureLoaded)();
+        PIMPL_(usageCount)++;
+        PIMPL_LOCK_END;
+    }
+
+    void Module::RemoveUsage() const noexcept
+    {
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(usageCount)--;
+        PIMPL_(lastUsed) = std::chrono::steady_clock::now();
+        PIMPL_LOCK_END;
+    }
+
+    /******************************************************************************/
+
+    CLASS_IMPLEMENTATION(ModuleUsage,
+                         PIMPL_CONSTRUCTOR(const Module& module) : module(module) { module.AddUsage(); }
+                         PIMPL_DECONSTRUCTOR() { module.RemoveUsage(); }
+public:
+    const Module module;
+    );
+
+    ModuleUsage::ModuleUsage(const Module& module) : PIMPL_INIT(module) {}
 }
@@ -21,11 +21,22 @@
 #include "pimpl.hpp"
 #include "sevenzip.hpp"
 
+#include <chrono>
 #include <filesystem>
 
 namespace archive
 {
-    class Module; // holds a reference to a format library and pointers to its methods
+    class Module; // holds a reference to a format library and pointers to its methods, the library gets loaded on demand
+    class ModuleUsage; // keeps a module's library loaded as long as any copy exists
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION(ModuleUsage,
+    friend class Module;
+
+private:
+    explicit ModuleUsage(const Module& module);
+    );
 
     /******************************************************************************/
 
@@ -35,8 +46,13 @@ namespace archive
 
     PROPERTY_READONLY(const std::filesystem::path&, Path, PIMPL_GETTER_ATTRIB);
 
-    HRESULT CreateObject(REFCLSID rclsid, REFIID riid, void*& ppv) const noexcept;
+    HRESULT CreateObject(REFCLSID rclsid, REFIID riid, void*& ppv) const noexcept; // the caller must hold a usage until the object is released
     HRESULT GetNumberOfFormats(UINT32& count) const noexcept;
     HRESULT GetFormatProperty(UINT32 index, sevenzip::HandlerPropertyId propId, PROPVARIANT& value) const noexcept;
+
+    ModuleUsage Use() const; // loads the library if necessary
+    void AddUsage() const; // prefer Use
+    void RemoveUsage() const noexcept; // dito
+    bool UnloadIfIdle(std::chrono::steady_clock::duration idleTime) const noexcept; // only if there are no usages
     );
 }
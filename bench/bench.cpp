@@ -0,0 +1,366 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "com.hpp"
+#include "counters.hpp"
+#include "settings.hpp"
+#include "win32.hpp"
+
+#include "ArchiveReader.hpp"
+#include "Factory.hpp"
+#include "FileBuffer.hpp"
+#include "FileDescription.hpp"
+#include "Filter.hpp"
+#include "ReadStream.hpp"
+#include "Registrar.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cwchar>
+#include <filesystem>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// console harness that drives the pipeline the way Windows Search or an embedding program would, see README for the modes
+
+/******************************************************************************/
+
+static auto _allocations = std::atomic<ULONGLONG>(0); // every operator new of the entire process, including the static libraries
+
+void* operator new(size_t size)
+{
+    _allocations++;
+    const auto ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == nullptr) { throw std::bad_alloc(); }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+/******************************************************************************/
+
+namespace bench
+{
+    struct Totals
+    {
+        ULONGLONG Chunks = 0;
+        ULONGLONG Characters = 0;
+        ULONGLONG Values = 0;
+    };
+
+    template <typename Action>
+    static void Measure(const wchar_t* name, ULONG iterations, Action&& action)
+    {
+        // one run to warm up caches and modules, then the measured ones
+        action();
+        const auto allocations = _allocations.load();
+        const auto start = std::chrono::steady_clock::now();
+        for (auto i = ULONG(0); i < iterations; i++) { action(); }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double, std::micro>>(std::chrono::steady_clock::now() - start).count();
+        std::wprintf(L"%-24s %10.3f us/op %12.1f allocations/op (%lu ops)\n", name, elapsed / iterations, static_cast<double>(_allocations - allocations) / iterations, iterations);
+    }
+
+    static void PrintTotals(const std::filesystem::path& path, const Totals& totals)
+    {
+        std::wprintf(L"%s: %llu chunks, %llu characters, %llu values\n", path.c_str(), totals.Chunks, totals.Characters, totals.Values);
+    }
+
+    /******************************************************************************/
+
+    // IFilter::GetChunk and IFilter::GetText, copying the text into a buffer like Windows Search does
+    static Totals FilterFile(const std::filesystem::path& path)
+    {
+        auto totals = Totals();
+        auto filter = com::Filter::CreateComInstance<IFilter>();
+        auto persistFile = IPersistFilePtr();
+        COM_DO_OR_THROW(filter->QueryInterface<IPersistFile>(&persistFile));
+        COM_DO_OR_THROW(persistFile->Load(path.c_str(), STGM_READ));
+        auto flags = ULONG(0);
+        COM_DO_OR_THROW(filter->Init(embed::ArchiveReader::DefaultFlags, 0, nullptr, &flags));
+        auto buffer = std::vector<WCHAR>(0x1000);
+        auto stat = STAT_CHUNK();
+        while (true)
+        {
+            const auto chunkResult = filter->GetChunk(&stat);
+            if (chunkResult == FILTER_E_END_OF_CHUNKS) { break; }
+            if (chunkResult == FILTER_E_EMBEDDING_UNAVAILABLE || chunkResult == FILTER_E_LINK_UNAVAILABLE) { continue; }
+            COM_DO_OR_THROW(chunkResult);
+            totals.Chunks++;
+            if (stat.flags & CHUNK_TEXT)
+            {
+                while (true)
+                {
+                    auto length = static_cast<ULONG>(buffer.size());
+                    const auto textResult = filter->GetText(&length, buffer.data());
+                    if (textResult == FILTER_E_NO_MORE_TEXT) { break; }
+                    COM_DO_OR_THROW(textResult);
+                    totals.Characters += length;
+                    if (textResult == FILTER_S_LAST_TEXT) { break; }
+                }
+            }
+            if (stat.flags & CHUNK_VALUE)
+            {
+                auto value = static_cast<PROPVARIANT*>(nullptr);
+                while (SUCCEEDED(filter->GetValue(&value)))
+                {
+                    totals.Values++;
+                    ::PropVariantClear(value);
+                    ::CoTaskMemFree(value);
+                }
+            }
+            if (stat.attribute.psProperty.ulKind == PRSPEC_LPWSTR)
+            {
+                ::CoTaskMemFree(stat.attribute.psProperty.lpwstr);
+            }
+        }
+        return totals;
+    }
+
+    // embed::ArchiveReader::Next, only looking at the views
+    static Totals ReadFile(const std::filesystem::path& path)
+    {
+        auto totals = Totals();
+        auto reader = embed::ArchiveReader(path);
+        while (const auto chunk = reader.Next())
+        {
+            totals.Chunks++;
+            totals.Characters += chunk->Text.length();
+            if (chunk->Value != nullptr) { totals.Values++; }
+        }
+        return totals;
+    }
+
+    static void RunText(const std::vector<std::filesystem::path>& paths, ULONG iterations, bool useFilter)
+    {
+        for (const auto& path : paths)
+        {
+            auto totals = Totals();
+            Measure(useFilter ? L"IFilter::GetText" : L"ArchiveReader::Next", iterations, [&]() -> void { totals = useFilter ? FilterFile(path) : ReadFile(path); });
+            PrintTotals(path, totals);
+        }
+    }
+
+    /******************************************************************************/
+
+    static void RunFactory(bool cold)
+    {
+        // the format table is built once per process, so cold and warm starts need a process each
+        if (cold)
+        {
+            auto error = std::error_code();
+            std::filesystem::remove(utils::get_module_file_path(nullptr).parent_path() / L"iFilter4Archives.formats", error);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const auto formats = archive::Factory::GetInstance().Formats.size();
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        std::wprintf(L"%-24s %10lld us (%zu extensions, %llu modules cached, %llu queried)\n", cold ? L"Factory (cold)" : L"Factory (warm)", static_cast<long long>(elapsed), formats, counters::value(counters::counter::factory_modules_cached), counters::value(counters::counter::factory_modules_queried));
+    }
+
+    static void RunLookup(const std::vector<std::wstring>& extensions, ULONG iterations)
+    {
+        // the first pass fills the misses, the compacted registrar reads them without locking
+        auto registrar = com::Registrar();
+        for (const auto& extension : extensions) { registrar.FindClsid(extension); }
+        registrar = registrar.Compact();
+        Measure(L"Registrar::FindClsid", iterations, [&]() -> void
+        {
+            for (const auto& extension : extensions) { registrar.FindClsid(extension); }
+        });
+    }
+
+    static void RunQueryInterface(ULONG iterations)
+    {
+        const auto filter = com::Filter::CreateComInstance<IUnknown>();
+        const auto query = [&](REFIID iid) -> void
+        {
+            auto ptr = static_cast<void*>(nullptr);
+            if (SUCCEEDED(filter->QueryInterface(iid, &ptr))) { static_cast<IUnknown*>(ptr)->Release(); }
+        };
+        Measure(L"QueryInterface (hit)", iterations, [&]() -> void { query(__uuidof(IFilter)); query(__uuidof(IPersistFile)); query(__uuidof(com::IFilter4Archives)); });
+        Measure(L"QueryInterface (miss)", iterations, [&]() -> void { query(__uuidof(IStream)); query(__uuidof(IDispatch)); query(__uuidof(IMarshal)); });
+    }
+
+    static void RunBuffer(ULONG size, ULONG iterations)
+    {
+        // a description of the requested size, whether the buffer spills depends on MaximumBufferSize
+        auto source = IStreamPtr();
+        COM_DO_OR_THROW(::CreateStreamOnHGlobal(nullptr, TRUE, &source));
+        COM_DO_OR_THROW(source->SetSize(ULARGE_INTEGER{ size }));
+        const auto description = com::FileDescription::FromIStream(source);
+        auto target = IStreamPtr();
+        COM_DO_OR_THROW(::CreateStreamOnHGlobal(nullptr, TRUE, &target));
+        COM_DO_OR_THROW(target->SetSize(ULARGE_INTEGER{ size }));
+        std::wprintf(L"%lu bytes, %s\n", size, size > settings::maximum_buffer_size() ? L"spilled to disk" : L"in memory");
+
+        const auto block = std::vector<BYTE>(0x10000, BYTE('x'));
+        auto buffer = std::optional<streams::FileBuffer>();
+        Measure(L"FileBuffer::Append", iterations, [&]() -> void
+        {
+            buffer.emplace(description);
+            for (auto written = ULONG(0); written < size;)
+            {
+                written += buffer->Append(block.data(), std::min(static_cast<ULONG>(block.size()), size - written));
+            }
+            buffer->SetEndOfFile();
+        });
+        const auto stream = streams::ReadStream::CreateComInstance<IStream>(*buffer);
+        Measure(L"ReadStream::CopyTo", iterations, [&]() -> void
+        {
+            COM_DO_OR_THROW(stream->Seek(LARGE_INTEGER(), STREAM_SEEK_SET, nullptr));
+            COM_DO_OR_THROW(target->Seek(LARGE_INTEGER(), STREAM_SEEK_SET, nullptr));
+            COM_DO_OR_THROW(stream->CopyTo(target, ULARGE_INTEGER{ size }, nullptr, nullptr));
+        });
+    }
+
+    static void RunContention(ULONG size, ULONG readers, ULONG iterations)
+    {
+        // one writer appends small pieces while the readers follow it, like sub-filters reading an item 7-Zip is still decoding
+        constexpr auto PieceSize = ULONG(512);
+        constexpr auto ReadSize = ULONG(0x1000);
+        auto source = IStreamPtr();
+        COM_DO_OR_THROW(::CreateStreamOnHGlobal(nullptr, TRUE, &source));
+        COM_DO_OR_THROW(source->SetSize(ULARGE_INTEGER{ size }));
+        const auto description = com::FileDescription::FromIStream(source);
+        const auto piece = std::vector<BYTE>(PieceSize, BYTE('x'));
+
+        auto reads = std::atomic<ULONGLONG>(0);
+        auto appends = ULONGLONG(0);
+        const auto waitedReads = counters::value(counters::counter::buffer_reads_waited);
+        const auto wakeups = counters::value(counters::counter::buffer_wakeups);
+        const auto start = std::chrono::steady_clock::now();
+        for (auto i = ULONG(0); i < iterations; i++)
+        {
+            auto buffer = streams::FileBuffer(description);
+            auto threads = std::vector<std::thread>();
+            for (auto reader = ULONG(0); reader < readers; reader++)
+            {
+                threads.emplace_back([&buffer, &reads, size]() -> void
+                {
+                    auto data = std::vector<BYTE>(ReadSize);
+                    auto count = ULONGLONG(0);
+                    try
+                    {
+                        for (auto offset = ULONGLONG(0); offset < size; count++)
+                        {
+                            const auto bytesRead = buffer.Read(offset, data.data(), ReadSize);
+                            if (bytesRead == 0) { break; } // write error
+                            offset += bytesRead;
+                        }
+                    }
+                    catch (...) {}
+                    reads += count;
+                });
+            }
+            for (auto written = ULONG(0); written < size; appends++)
+            {
+                written += buffer.Append(piece.data(), std::min(PieceSize, size - written));
+            }
+            buffer.SetEndOfFile();
+            for (auto& thread : threads) { thread.join(); }
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+
+        // reads that didn't wait never locked, appends that didn't wake anyone up got coalesced
+        const auto totalReads = reads.load();
+        const auto totalWaited = counters::value(counters::counter::buffer_reads_waited) - waitedReads;
+        const auto totalWakeups = counters::value(counters::counter::buffer_wakeups) - wakeups;
+        std::wprintf(L"%lu bytes, %lu readers, %s\n", size, readers, size > settings::maximum_buffer_size() ? L"spilled to disk" : L"in memory");
+        std::wprintf(L"%-24s %12.0f reads/s %9.1f%% without locking\n", L"FileBuffer::Read", totalReads / elapsed, totalReads > 0 ? 100.0 * (totalReads - totalWaited) / totalReads : 0.0);
+        std::wprintf(L"%-24s %12llu appends %9llu wakeups (%.1f%% coalesced)\n", L"FileBuffer::Append", appends, totalWakeups, appends > 0 ? 100.0 * (appends > totalWakeups ? appends - totalWakeups : 0) / appends : 0.0);
+    }
+
+    /******************************************************************************/
+
+    static int Usage()
+    {
+        std::fputws(
+            L"usage: bench [-n iterations] mode [arguments]\n"
+            L"  filter archive...   IFilter::GetChunk and GetText over each archive\n"
+            L"  next archive...     embed::ArchiveReader::Next over each archive\n"
+            L"  factory [cold]      builds the format table, cold deletes the format cache first\n"
+            L"  lookup ext...       Registrar::FindClsid for dot-prefixed extensions\n"
+            L"  qi                  QueryInterface on a Filter for present and missing interfaces\n"
+            L"  buffer bytes        FileBuffer::Append and ReadStream::CopyTo for an item of that size\n"
+            L"  contention bytes n  one writer appending small pieces to an item of that size while n threads read it\n",
+            stderr);
+        return 2;
+    }
+
+    static int Run(int argc, wchar_t** argv)
+    {
+        // parse the arguments
+        auto iterations = ULONG(10);
+        auto arg = 1;
+        if (arg + 1 < argc && std::wstring_view(argv[arg]) == L"-n")
+        {
+            iterations = std::wcstoul(argv[arg + 1], nullptr, 10);
+            arg += 2;
+        }
+        if (arg >= argc || iterations == 0) { return Usage(); }
+        const auto mode = std::wstring_view(argv[arg++]);
+        auto arguments = std::vector<std::wstring>(argv + arg, argv + argc);
+
+        // run the mode
+        if (mode == L"filter" || mode == L"next")
+        {
+            if (arguments.empty()) { return Usage(); }
+            RunText(std::vector<std::filesystem::path>(arguments.begin(), arguments.end()), iterations, mode == L"filter");
+        }
+        else if (mode == L"factory") { RunFactory(!arguments.empty() && arguments.front() == L"cold"); }
+        else if (mode == L"lookup")
+        {
+            if (arguments.empty()) { return Usage(); }
+            RunLookup(arguments, iterations);
+        }
+        else if (mode == L"qi") { RunQueryInterface(iterations); }
+        else if (mode == L"buffer")
+        {
+            if (arguments.size() != 1) { return Usage(); }
+            RunBuffer(std::wcstoul(arguments.front().c_str(), nullptr, 10), iterations);
+        }
+        else if (mode == L"contention")
+        {
+            if (arguments.size() != 2) { return Usage(); }
+            const auto readers = std::wcstoul(arguments[1].c_str(), nullptr, 10);
+            if (readers == 0) { return Usage(); }
+            RunContention(std::wcstoul(arguments[0].c_str(), nullptr, 10), readers, iterations);
+        }
+        else { return Usage(); }
+        counters::trace();
+        return 0;
+    }
+}
+
+int wmain(int argc, wchar_t** argv)
+{
+    auto result = S_OK;
+    auto exitCode = 1;
+    COM_THREAD_BEGIN(COINIT_MULTITHREADED);
+    exitCode = bench::Run(argc, argv);
+    COM_THREAD_END(result);
+    if (FAILED(result)) { std::fwprintf(stderr, L"failed with 0x%08lX\n", static_cast<unsigned long>(result)); }
+    return exitCode;
+}
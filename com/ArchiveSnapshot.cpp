@@ -0,0 +1,133 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ArchiveSnapshot.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace com
+{
+    CLASS_IMPLEMENTATION(ArchiveSnapshot,
+public:
+    sevenzip::IInArchive* Archive = nullptr;
+    UINT32 Count = 0;
+    std::wstring names; // all names, each followed by a null terminator
+    std::vector<size_t> nameOffsets; // one more than there are items
+    std::vector<bool> directories;
+    std::vector<ULONGLONG> sizes;
+    std::vector<ULONGLONG> storedOffsets; // empty if not queried
+    std::vector<ULONGLONG> crcs; // dito
+    );
+
+    static bool IsStoredMethod(const win32::propvariant& propv) noexcept
+    {
+        // formats without methods (e.g. tar) don't report one at all
+        if (propv.vt == VT_EMPTY) { return true; }
+        if (propv.vt != VT_BSTR || propv.bstrVal == nullptr) { return false; }
+        return ::CompareStringOrdinal(propv.bstrVal, -1, L"Store", -1, true) == CSTR_EQUAL || ::CompareStringOrdinal(propv.bstrVal, -1, L"Copy", -1, true) == CSTR_EQUAL;
+    }
+
+    static ULONGLONG QueryStoredOffset(sevenzip::IInArchive* archive, UINT32 index, bool isDirectory, ULONGLONG size, win32::propvariant& propv)
+    {
+        // only unencrypted files without compression, i.e. at least as many packed bytes as there are unpacked ones
+        if (isDirectory || size == MAXULONGLONG) { return MAXULONGLONG; }
+        COM_DO_OR_THROW(archive->GetProperty(index, sevenzip::PropertyId::Encrypted, &propv));
+        const auto isEncrypted = ::PropVariantToBooleanWithDefault(propv, false);
+        propv.clear();
+        if (isEncrypted) { return MAXULONGLONG; }
+        COM_DO_OR_THROW(archive->GetProperty(index, sevenzip::PropertyId::Method, &propv));
+        const auto isStored = IsStoredMethod(propv);
+        propv.clear();
+        if (!isStored) { return MAXULONGLONG; }
+        COM_DO_OR_THROW(archive->GetProperty(index, sevenzip::PropertyId::PackSize, &propv));
+        const auto packSize = ::PropVariantToUInt64WithDefault(propv, 0);
+        propv.clear();
+        if (packSize < size) { return MAXULONGLONG; }
+        COM_DO_OR_THROW(archive->GetProperty(index, sevenzip::PropertyId::Offset, &propv));
+        const auto offset = ::PropVariantToUInt64WithDefault(propv, MAXULONGLONG);
+        propv.clear();
+        return offset;
+    }
+
+    ArchiveSnapshot::ArchiveSnapshot(sevenzip::IInArchive* archive, bool queryStoredOffsets, bool queryCrcs) : PIMPL_INIT()
+    {
+        if (archive == nullptr) { throw std::invalid_argument("archive"); }
+
+        PIMPL_(Archive) = archive;
+        COM_DO_OR_THROW(archive->GetNumberOfItems(&PIMPL_(Count)));
+        PIMPL_(nameOffsets).reserve(static_cast<size_t>(PIMPL_(Count)) + 1);
+        PIMPL_(directories).reserve(PIMPL_(Count));
+        PIMPL_(sizes).reserve(PIMPL_(Count));
+        if (queryStoredOffsets) { PIMPL_(storedOffsets).reserve(PIMPL_(Count)); }
+        if (queryCrcs) { PIMPL_(crcs).reserve(PIMPL_(Count)); }
+
+        // query the properties that are needed for every item, reusing a single PROPVARIANT
+        auto propv = win32::propvariant();
+        for (auto i = UINT32(0); i < PIMPL_(Count); i++)
+        {
+            PIMPL_(nameOffsets).push_back(PIMPL_(names).length());
+            COM_DO_OR_THROW(archive->GetProperty(i, sevenzip::PropertyId::Path, &propv));
+            if (propv.vt == VT_BSTR && propv.bstrVal != nullptr)
+            {
+                PIMPL_(names).append(propv.bstrVal, ::SysStringLen(propv.bstrVal));
+            }
+            PIMPL_(names).push_back(CHR('\0'));
+            propv.clear();
+
+            COM_DO_OR_THROW(archive->GetProperty(i, sevenzip::PropertyId::IsDir, &propv));
+            PIMPL_(directories).push_back(::PropVariantToBooleanWithDefault(propv, false));
+            propv.clear();
+
+            COM_DO_OR_THROW(archive->GetProperty(i, sevenzip::PropertyId::Size, &propv));
+            PIMPL_(sizes).push_back(::PropVariantToUInt64WithDefault(propv, MAXULONGLONG));
+            propv.clear();
+
+            if (queryStoredOffsets)
+            {
+                PIMPL_(storedOffsets).push_back(QueryStoredOffset(archive, i, PIMPL_(directories).back(), PIMPL_(sizes).back(), propv));
+            }
+
+            if (queryCrcs)
+            {
+                COM_DO_OR_THROW(archive->GetProperty(i, sevenzip::PropertyId::CRC, &propv));
+                PIMPL_(crcs).push_back(propv.vt == VT_UI4 ? propv.ulVal : MAXULONGLONG); // formats without checksums don't report one
+                propv.clear();
+            }
+        }
+        PIMPL_(nameOffsets).push_back(PIMPL_(names).length());
+    }
+
+    PIMPL_GETTER(ArchiveSnapshot, sevenzip::IInArchive*, Archive);
+    PIMPL_GETTER(ArchiveSnapshot, UINT32, Count);
+
+    std::wstring_view ArchiveSnapshot::GetName(UINT32 index) const noexcept
+    {
+        const auto offset = PIMPL_(nameOffsets)[index];
+        return std::wstring_view(PIMPL_(names).data() + offset, PIMPL_(nameOffsets)[static_cast<size_t>(index) + 1] - offset - 1); // without the null terminator
+    }
+
+    bool ArchiveSnapshot::IsDirectory(UINT32 index) const noexcept { return PIMPL_(directories)[index]; }
+
+    ULONGLONG ArchiveSnapshot::GetSize(UINT32 index) const noexcept { return PIMPL_(sizes)[index]; }
+
+    ULONGLONG ArchiveSnapshot::GetStoredOffset(UINT32 index) const noexcept { return index < PIMPL_(storedOffsets).size() ? PIMPL_(storedOffsets)[index] : MAXULONGLONG; }
+
+    ULONGLONG ArchiveSnapshot::GetCrc(UINT32 index) const noexcept { return index < PIMPL_(crcs).size() ? PIMPL_(crcs)[index] : MAXULONGLONG; }
+}
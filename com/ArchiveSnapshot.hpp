@@ -0,0 +1,46 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "com.hpp"
+#include "pimpl.hpp"
+#include "sevenzip.hpp"
+
+#include <string_view>
+
+namespace com
+{
+    class ArchiveSnapshot; // the names, directory flags and sizes of all items of an archive, queried at once
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION(ArchiveSnapshot,
+public:
+    ArchiveSnapshot(sevenzip::IInArchive* archive, bool queryStoredOffsets, bool queryCrcs);
+
+    PROPERTY_READONLY(sevenzip::IInArchive*, Archive, PIMPL_GETTER_ATTRIB); // not referenced, only valid while the archive is being extracted
+    PROPERTY_READONLY(UINT32, Count, PIMPL_GETTER_ATTRIB);
+
+    std::wstring_view GetName(UINT32 index) const noexcept; // null-terminated
+    bool IsDirectory(UINT32 index) const noexcept;
+    ULONGLONG GetSize(UINT32 index) const noexcept; // MAXULONGLONG if unknown
+    ULONGLONG GetStoredOffset(UINT32 index) const noexcept; // offset reported for an unencrypted item without compression, MAXULONGLONG otherwise or if not queried
+    ULONGLONG GetCrc(UINT32 index) const noexcept; // MAXULONGLONG if unknown or not queried
+    );
+}
@@ -19,9 +19,11 @@
 #include "CachedChunk.hpp"
 
 #include <memory>
+#include <new>
+#include <optional>
 #include <stdexcept>
-#include <string>
-#include <vector>
+#include <string_view>
+#include <utility>
 
 namespace com
 {
@@ -37,22 +39,55 @@ namespace com
 
     /******************************************************************************/
 
-    CLASS_IMPLEMENTATION(CachedChunk,
+    CLASS_IMPLEMENTATION_INLINE(CachedChunk,
+                         PIMPL_DECONSTRUCTOR()
+    {
+        if (pipe) { pipe->Cancel(); } // let the gatherer move on if the text didn't get read completely
+    }
 public:
     bool isSpecialChunk;
     SCODE statResult;
     STAT_CHUNK stat;
-    std::wstring propName;
-    std::vector<WCHAR> text;
+    std::wstring_view text; // owned by the arena
+    std::optional<TextPipe> pipe;
     unique_propvariant_cache_ptr value;
     size_t textOffset = 0;
     bool isMapped = false;
     );
 
+    CachedChunk::impl::impl(impl&& other) noexcept :
+        isSpecialChunk(other.isSpecialChunk),
+        statResult(other.statResult),
+        stat(other.stat),
+        text(other.text),
+        pipe(std::exchange(other.pipe, std::nullopt)), // the moved-from impl must not cancel it
+        value(std::move(other.value)),
+        textOffset(other.textOffset),
+        isMapped(other.isMapped)
+    {}
+
     CachedChunk::CachedChunk() : PIMPL_INIT() {}
 
     SCODE CachedChunk::GetCode() const noexcept { return PIMPL_(statResult); }
 
+    bool CachedChunk::GetIsPiped() const noexcept { return PIMPL_(pipe).has_value(); }
+
+    bool CachedChunk::GetIsName() const noexcept { return PIMPL_(isSpecialChunk) && SUCCEEDED(PIMPL_(statResult)); }
+
+    const STAT_CHUNK& CachedChunk::GetStat() const noexcept { return PIMPL_(stat); }
+
+    std::wstring_view CachedChunk::GetUnreadText() const noexcept
+    {
+        if (FAILED(PIMPL_(statResult)) || !(PIMPL_(stat).flags & CHUNKSTATE::CHUNK_TEXT) || PIMPL_(textOffset) >= PIMPL_(text).length()) { return std::wstring_view(); }
+        return PIMPL_(text).substr(PIMPL_(textOffset));
+    }
+
+    const PROPVARIANT* CachedChunk::GetPendingValue() const noexcept
+    {
+        if (FAILED(PIMPL_(statResult)) || !(PIMPL_(stat).flags & CHUNKSTATE::CHUNK_VALUE)) { return nullptr; }
+        return PIMPL_(value).get();
+    }
+
     SCODE CachedChunk::GetChunk(STAT_CHUNK* pStat) noexcept
     {
         *pStat = PIMPL_(stat);
@@ -65,9 +100,10 @@ namespace com
         COM_CHECK_POINTER(awcBuffer);
         if (*pcwcBuffer == 0) { return E_NOT_SUFFICIENT_BUFFER; } // need at least space for the null terminator
         if (FAILED(PIMPL_(statResult)) || !(PIMPL_(stat).flags & CHUNKSTATE::CHUNK_TEXT)) { return FILTER_E_NO_TEXT; }
-        if (PIMPL_(textOffset) >= PIMPL_(text).size()) { return FILTER_E_NO_MORE_TEXT; }
+        if (PIMPL_(pipe)) { return PIMPL_(pipe)->Read(pcwcBuffer, awcBuffer); }
+        if (PIMPL_(textOffset) >= PIMPL_(text).length()) { return FILTER_E_NO_MORE_TEXT; }
 
-        const auto remaining = PIMPL_(text).size() - PIMPL_(textOffset);
+        const auto remaining = PIMPL_(text).length() - PIMPL_(textOffset);
         if (*pcwcBuffer >= remaining + 1) // plus one for the null terminator
         {
             std::wmemcpy(awcBuffer, PIMPL_(text).data() + PIMPL_(textOffset), remaining);
@@ -125,7 +161,35 @@ namespace com
         PIMPL_(isMapped) = true;
     }
 
-    CachedChunk CachedChunk::FromFileDescription(const FileDescription& description)
+    CachedChunk CachedChunk::Replay() const
+    {
+        if (PIMPL_(pipe) || PIMPL_(isMapped)) { throw std::logic_error("piped or mapped chunk"); }
+
+        // the text and property name stay in the original arena
+        auto result = CachedChunk();
+        result.PIMPL_(isSpecialChunk) = PIMPL_(isSpecialChunk);
+        result.PIMPL_(statResult) = PIMPL_(statResult);
+        result.PIMPL_(stat) = PIMPL_(stat);
+        result.PIMPL_(text) = PIMPL_(text);
+        if (PIMPL_(value))
+        {
+            auto& value = result.PIMPL_(value);
+            value.reset(static_cast<PROPVARIANT*>(::CoTaskMemAlloc(sizeof(PROPVARIANT))));
+            if (!value) { throw std::bad_alloc(); }
+            ::PropVariantInit(value.get());
+            COM_DO_OR_THROW(::PropVariantCopy(value.get(), PIMPL_(value).get()));
+        }
+        return result;
+    }
+
+    constexpr static const auto ContainerChildPropName = STR("urn:schemas.microsoft.com:container:child");
+
+    CachedChunk CachedChunk::FromFileDescription(const FileDescription& description, TextArena& arena)
+    {
+        return FromName(arena.Copy(description.Name));
+    }
+
+    CachedChunk CachedChunk::FromName(std::wstring_view name)
     {
         auto result = CachedChunk();
         result.PIMPL_(isSpecialChunk) = true;
@@ -135,8 +199,6 @@ namespace com
         stat.breakType = CHUNK_BREAKTYPE::CHUNK_EOS;
 
         // set the child property
-        auto& propName = result.PIMPL_(propName);
-        propName.assign(STR("urn:schemas.microsoft.com:container:child"));
         stat.attribute.guidPropSet.Data1 = 0x560C36C0;
         stat.attribute.guidPropSet.Data2 = 0x503A;
         stat.attribute.guidPropSet.Data3 = 0x11CF;
@@ -148,19 +210,16 @@ namespace com
         stat.attribute.guidPropSet.Data4[5] = 0x75;
         stat.attribute.guidPropSet.Data4[6] = 0x2A;
         stat.attribute.guidPropSet.Data4[7] = 0x9A;
-        stat.attribute.psProperty.lpwstr = const_cast<wchar_t*>(propName.c_str());
+        stat.attribute.psProperty.lpwstr = const_cast<wchar_t*>(ContainerChildPropName.c_str()); // is handled as const
 
         // store the file name as text
         stat.flags = CHUNKSTATE::CHUNK_TEXT;
-        auto& text = result.PIMPL_(text);
-        const auto& name = description.Name;
-        text.reserve(name.length());
-        text.assign(name.begin(), name.end());
+        result.PIMPL_(text) = name;
 
         return result;
     }
 
-    CachedChunk CachedChunk::FromFilter(IFilter* filter)
+    CachedChunk CachedChunk::FromFilter(IFilter* filter, TextArena& arena, const TextPipe* pipe)
     {
         if (filter == nullptr) { throw std::invalid_argument("filter"); }
 
@@ -172,39 +231,35 @@ namespace com
             // create a copy of the prop name (the filter's DLL might get unloaded)
             if (stat.attribute.psProperty.ulKind == PRSPEC_LPWSTR)
             {
-                auto& propName = result.PIMPL_(propName);
-                propName.assign(stat.attribute.psProperty.lpwstr);
-                stat.attribute.psProperty.lpwstr = const_cast<wchar_t*>(propName.c_str()); // is handled as const
+                stat.attribute.psProperty.lpwstr = const_cast<wchar_t*>(arena.Copy(stat.attribute.psProperty.lpwstr).data()); // is handled as const
             }
 
-            // cache the chunk's text
-            if (stat.flags & CHUNKSTATE::CHUNK_TEXT)
+            // either leave the text to the pipe (the caller fills it) or cache it directly in the arena
+            if (pipe != nullptr && stat.flags == CHUNKSTATE::CHUNK_TEXT)
             {
-                auto& text = result.PIMPL_(text);
+                result.PIMPL_(pipe) = *pipe;
+            }
+            else if (stat.flags & CHUNKSTATE::CHUNK_TEXT)
+            {
+                auto offset = size_t(0);
                 while (true)
                 {
                     auto length = ULONG(8000); // with null terminator on in, without null terminator on out
-                    const auto offset = text.size();
-                    text.resize(offset + length);
-                    const auto textResult = filter->GetText(&length, text.data() + offset);
+                    const auto textResult = filter->GetText(&length, arena.Grow(offset, length) + offset);
                     if (FAILED(textResult))
                     {
                         if (textResult != FILTER_E_NO_MORE_TEXT)
                         {
                             // remove the text on failures
-                            text.clear();
+                            offset = 0;
                             stat.flags = static_cast<CHUNKSTATE>(stat.flags & ~CHUNKSTATE::CHUNK_TEXT);
                         }
-                        else
-                        {
-                            text.resize(offset);
-                        }
                         break;
                     }
-                    text.resize(offset + length);
+                    offset += length;
                     if (textResult == FILTER_S_LAST_TEXT) { break; } // no need to call GetText again
                 }
-                text.shrink_to_fit();
+                result.PIMPL_(text) = arena.Seal(offset);
             }
 
             // cache the chunk's value
@@ -22,16 +22,18 @@
 #include "pimpl.hpp"
 
 #include "FileDescription.hpp"
+#include "TextArena.hpp"
+#include "TextPipe.hpp"
 
 #include <unordered_map>
 
 namespace com
 {
-    class CachedChunk; // holds all information from an iFilter chunk
+    class CachedChunk; // holds all information from an iFilter chunk, its text is a view into the arena it got created with or streamed through a pipe, move-only and without an allocation of its own
 
     /******************************************************************************/
 
-    CLASS_DECLARATION(CachedChunk,
+    CLASS_DECLARATION_INLINE(CachedChunk, sizeof(void*) * 32,
 private:
     CachedChunk();
 
@@ -39,15 +41,22 @@ namespace com
     using IdMap = std::unordered_map<ULONG, ULONG>;
 
     PROPERTY_READONLY(SCODE, Code, const noexcept);
+    PROPERTY_READONLY(bool, IsPiped, const noexcept); // the text has yet to be passed through TextPipe::Fill
+    PROPERTY_READONLY(bool, IsName, const noexcept); // the chunk carries an item's name and precedes its content
+    PROPERTY_READONLY(const STAT_CHUNK&, Stat, const noexcept);
+    PROPERTY_READONLY(std::wstring_view, UnreadText, const noexcept); // the unread text as a view into the arena, empty for piped chunks
+    PROPERTY_READONLY(const PROPVARIANT*, PendingValue, const noexcept); // nullptr if there is none or GetValue already handed it out
 
     SCODE GetChunk(STAT_CHUNK* pStat) noexcept;
     SCODE GetText(ULONG* pcwcBuffer, WCHAR* awcBuffer) noexcept;
     SCODE GetValue(PROPVARIANT** ppPropValue) noexcept;
 
     void Map(ULONG newId, IdMap& idMap);
+    CachedChunk Replay() const; // unmapped copy sharing the text, not for piped chunks
 
-    static CachedChunk FromFileDescription(const FileDescription& description);
-    static CachedChunk FromFilter(IFilter* filter);
+    static CachedChunk FromFileDescription(const FileDescription& description, TextArena& arena);
+    static CachedChunk FromFilter(IFilter* filter, TextArena& arena, const TextPipe* pipe = nullptr); // text is piped instead of cached if a pipe is given
+    static CachedChunk FromName(std::wstring_view name); // the name is not copied, so it must outlive the chunk
     static CachedChunk FromHResult(HRESULT hr);
     );
 }
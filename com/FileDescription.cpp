@@ -18,47 +18,32 @@
 
 #include "FileDescription.hpp"
 
-#include <filesystem>
-#include <functional>
-#include <mutex>
+#include "extension_table.hpp"
+
+#include <optional>
 #include <stdexcept>
+#include <string>
 
 namespace com
 {
     CLASS_IMPLEMENTATION(FileDescription,
 public:
-    std::wstring Name;
-    std::mutex extensionCacheMutex;
-    std::wstring extensionCache;
-    bool extensionCacheValid = false;
+    std::optional<ArchiveSnapshot> snapshot; // for archive items, which only store their index
+    UINT32 index = 0;
+    std::wstring name; // for all others
     bool IsDirectory;
     ULONGLONG Size;
     bool SizeIsValid;
     FILETIME ModificationTime;
     FILETIME CreationTime;
     FILETIME AccessTime;
+    bool timesLoaded = false;
     );
 
     FileDescription::FileDescription() : PIMPL_INIT() {}
 
-    PIMPL_GETTER(FileDescription, const std::wstring&, Name);
-    const std::wstring& FileDescription::GetExtension() const
-    {
-        // this function may be called from multiple threads, so ensure locking
-        PIMPL_LOCK_BEGIN(extensionCacheMutex);
-        if (!PIMPL_(extensionCacheValid))
-        {
-            // get the lower-case extension
-            PIMPL_(extensionCache).assign(std::filesystem::path(PIMPL_(Name)).extension());
-            PIMPL_(extensionCache).push_back(CHR('\0')); // _wcslwr_s expects a null terminator even if the length is given, and data() doesn't guarantee it
-            const auto result = _wcslwr_s(PIMPL_(extensionCache).data(), PIMPL_(extensionCache).length());
-            if (result != 0) { throw std::system_error(result, std::generic_category()); }
-            PIMPL_(extensionCache).pop_back();
-            PIMPL_(extensionCacheValid) = true;
-        }
-        return PIMPL_(extensionCache);
-        PIMPL_LOCK_END;
-    }
+    std::wstring_view FileDescription::GetName() const noexcept { return PIMPL_(snapshot) ? PIMPL_(snapshot)->GetName(PIMPL_(index)) : std::wstring_view(PIMPL_(name)); }
+    std::wstring_view FileDescription::GetExtension() const noexcept { return utils::extension_of(GetName()); }
     PIMPL_GETTER(FileDescription, bool, IsDirectory);
     ULONGLONG FileDescription::GetSize() const
     {
@@ -76,10 +61,11 @@ namespace com
 
         if (includeName)
         {
-            const auto sizeIncludingNullTerminator = (PIMPL_(Name).length() + 1) * sizeof(WCHAR);
+            const auto name = GetName();
+            const auto sizeIncludingNullTerminator = (name.length() + 1) * sizeof(WCHAR);
             stat->pwcsName = reinterpret_cast<LPOLESTR>(::CoTaskMemAlloc(sizeIncludingNullTerminator));
             if (stat->pwcsName == nullptr) { return E_OUTOFMEMORY; } // must not fail afterwards or we leak memory
-            std::memcpy(stat->pwcsName, PIMPL_(Name).c_str(), sizeIncludingNullTerminator);
+            std::memcpy(stat->pwcsName, name.data(), sizeIncludingNullTerminator); // the name is null-terminated
         }
         if (PIMPL_(SizeIsValid))
         {
@@ -91,40 +77,41 @@ namespace com
         return S_OK;
     }
 
-    template<typename T>
-    static T GetPropertyFromArchiveItem(sevenzip::IInArchive* archive, UINT32 index, sevenzip::PropertyId propId, std::function<T(const PROPVARIANT&)> extractor)
+    static FILETIME GetFileTimePropertyFromArchiveItem(sevenzip::IInArchive* archive, UINT32 index, sevenzip::PropertyId propId)
     {
         auto propVariant = win32::propvariant();
-        COM_DO_OR_THROW(archive->GetProperty(index, propId, &propVariant));
-        return extractor(propVariant);
+        auto ft = FILETIME();
+        if (FAILED(archive->GetProperty(index, propId, &propVariant)) || FAILED(::PropVariantToFileTime(propVariant, PSTF_UTC, &ft)))
+        {
+            ft.dwLowDateTime = 0;
+            ft.dwHighDateTime = 0;
+        }
+        return ft;
     }
 
-    static FILETIME GetFileTimePropertyFromArchiveItem(sevenzip::IInArchive* archive, UINT32 index, sevenzip::PropertyId propId)
+    void FileDescription::LoadTimes() const
     {
-        return GetPropertyFromArchiveItem<FILETIME>(archive, index, propId, [](const auto& propVariant)
-        {
-            auto ft = FILETIME();
-            if (FAILED(::PropVariantToFileTime(propVariant, PSTF_UTC, &ft)))
-            {
-                ft.dwLowDateTime = 0;
-                ft.dwHighDateTime = 0;
-            }
-            return ft;
-        });
+        if (!PIMPL_(snapshot) || PIMPL_(timesLoaded)) { return; }
+        const auto archive = PIMPL_(snapshot)->Archive;
+        PIMPL_(ModificationTime) = GetFileTimePropertyFromArchiveItem(archive, PIMPL_(index), sevenzip::PropertyId::MTime);
+        PIMPL_(CreationTime) = GetFileTimePropertyFromArchiveItem(archive, PIMPL_(index), sevenzip::PropertyId::CTime);
+        PIMPL_(AccessTime) = GetFileTimePropertyFromArchiveItem(archive, PIMPL_(index), sevenzip::PropertyId::ATime);
+        PIMPL_(timesLoaded) = true;
     }
 
-    FileDescription FileDescription::FromArchiveItem(sevenzip::IInArchive* archive, UINT32 index)
+    FileDescription FileDescription::FromArchiveItem(const ArchiveSnapshot& snapshot, UINT32 index)
     {
-        if (archive == nullptr) { throw std::invalid_argument("archive"); }
+        if (index >= snapshot.Count) { throw std::out_of_range("index"); }
 
         auto result = FileDescription();
-        result.PIMPL_(Name) = GetPropertyFromArchiveItem<std::wstring>(archive, index, sevenzip::PropertyId::Path, [](const auto& propVariant) { return std::wstring(::PropVariantToStringWithDefault(propVariant, STR("").c_str())); });
-        result.PIMPL_(IsDirectory) = GetPropertyFromArchiveItem<bool>(archive, index, sevenzip::PropertyId::IsDir, [](const auto& propVariant) { return ::PropVariantToBooleanWithDefault(propVariant, false); });
-        result.PIMPL_(Size) = GetPropertyFromArchiveItem<ULONGLONG>(archive, index, sevenzip::PropertyId::Size, [](const auto& propVariant) { return ::PropVariantToUInt64WithDefault(propVariant, MAXULONGLONG); });
+        result.PIMPL_(snapshot) = snapshot;
+        result.PIMPL_(index) = index;
+        result.PIMPL_(IsDirectory) = snapshot.IsDirectory(index);
+        result.PIMPL_(Size) = snapshot.GetSize(index);
         result.PIMPL_(SizeIsValid) = result.PIMPL_(Size) != MAXULONGLONG;
-        result.PIMPL_(ModificationTime) = GetFileTimePropertyFromArchiveItem(archive, index, sevenzip::PropertyId::MTime);
-        result.PIMPL_(CreationTime) = GetFileTimePropertyFromArchiveItem(archive, index, sevenzip::PropertyId::CTime);
-        result.PIMPL_(AccessTime) = GetFileTimePropertyFromArchiveItem(archive, index, sevenzip::PropertyId::ATime);
+        result.PIMPL_(ModificationTime) = FILETIME();
+        result.PIMPL_(CreationTime) = FILETIME();
+        result.PIMPL_(AccessTime) = FILETIME();
         return result;
     }
 
@@ -137,13 +124,14 @@ namespace com
         COM_DO_OR_THROW(stream->Stat(&stat, STATFLAG_DEFAULT));
         oleName.reset(stat.pwcsName);
         auto result = FileDescription();
-        result.PIMPL_(Name).assign(oleName.get());
+        result.PIMPL_(name).assign(oleName.get());
         result.PIMPL_(IsDirectory) = false;
         result.PIMPL_(Size) = stat.cbSize.QuadPart;
         result.PIMPL_(SizeIsValid) = true;
         result.PIMPL_(ModificationTime) = stat.mtime;
         result.PIMPL_(CreationTime) = stat.ctime;
         result.PIMPL_(AccessTime) = stat.atime;
+        result.PIMPL_(timesLoaded) = true;
         return result;
     }
 }
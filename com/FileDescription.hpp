@@ -22,7 +22,9 @@
 #include "pimpl.hpp"
 #include "sevenzip.hpp"
 
-#include <string>
+#include "ArchiveSnapshot.hpp"
+
+#include <string_view>
 
 namespace com
 {
@@ -35,18 +37,19 @@ namespace com
     FileDescription();
 
 public:
-    PROPERTY_READONLY(const std::wstring&, Name, PIMPL_GETTER_ATTRIB);
-    PROPERTY_READONLY(const std::wstring&, Extension, const); // guaranteed to be lower-case and dot-prefixed
+    PROPERTY_READONLY(std::wstring_view, Name, const noexcept); // null-terminated
+    PROPERTY_READONLY(std::wstring_view, Extension, const noexcept); // dot-prefixed but not case-folded, views into Name
     PROPERTY_READONLY(bool, IsDirectory, PIMPL_GETTER_ATTRIB);
     PROPERTY_READONLY(ULONGLONG, Size, const); // only throws if !SizeIsValid
     PROPERTY_READONLY(bool, SizeIsValid, PIMPL_GETTER_ATTRIB);
-    PROPERTY_READONLY(FILETIME, ModificationTime, PIMPL_GETTER_ATTRIB);
-    PROPERTY_READONLY(FILETIME, CreationTime, PIMPL_GETTER_ATTRIB);
-    PROPERTY_READONLY(FILETIME, AccessTime, PIMPL_GETTER_ATTRIB);
+    PROPERTY_READONLY(FILETIME, ModificationTime, PIMPL_GETTER_ATTRIB); // zero for archive items until LoadTimes is called
+    PROPERTY_READONLY(FILETIME, CreationTime, PIMPL_GETTER_ATTRIB); // dito
+    PROPERTY_READONLY(FILETIME, AccessTime, PIMPL_GETTER_ATTRIB); // dito
 
+    void LoadTimes() const; // only for archive items, must be called from the extractor thread before the description is shared
     HRESULT ToStat(STATSTG* stat, bool includeName) const noexcept;
 
-    static FileDescription FromArchiveItem(sevenzip::IInArchive* archive, UINT32 index);
+    static FileDescription FromArchiveItem(const ArchiveSnapshot& snapshot, UINT32 index);
     static FileDescription FromIStream(IStream* stream);
     );
 }
@@ -18,22 +18,40 @@
 
 #include "Filter.hpp"
 
+#include "counters.hpp"
+#include "extension_table.hpp"
 #include "settings.hpp"
+#include "threads.hpp"
 
+#include "ArchiveSnapshot.hpp"
 #include "BridgeStream.hpp"
 #include "CachedChunk.hpp"
 #include "Factory.hpp"
 #include "FileDescription.hpp"
+#include "HeaderStream.hpp"
 #include "ItemTask.hpp"
+#include "MappedFile.hpp"
+#include "MappedStream.hpp"
 #include "Registrar.hpp"
+#include "Sniffer.hpp"
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
+#include <filesystem>
 #include <list>
+#include <map>
 #include <mutex>
+#include <numeric>
 #include <thread>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace com
 {
@@ -68,32 +86,63 @@ namespace com
 
     /******************************************************************************/
 
+    static void EndExtractionTaskIfAny(std::optional<ItemTask>& task) // will not call COM
+    {
+        // end and clear the task if there is one
+        if (task)
+        {
+            task->SetEndOfExtraction();
+            task = std::nullopt;
+        }
+    }
+
+    //----------------------------------------------------------------------------//
+
     CLASS_IMPLEMENTATION(Filter,
                          PIMPL_DECONSTRUCTOR() { AbortAnyExtractionOrTasksAndReset(); }
 public:
     // used exclusively in the Windows thread
     std::optional<FilterAttributes> attributes;
     IStreamPtr stream;
+    std::wstring fileName; // only set if loaded from a file
+    std::optional<archive::ModuleUsage> archiveUsage; // must be declared before archive
     sevenzip::IInArchivePtr archive;
     std::thread extractor;
     ULONG currentChunkId;
     std::optional<CachedChunk> currentChunk;
     std::optional<ItemTask> currentChunkTask;
+    ItemTask::Deadline archiveDeadline;
+    ULONGLONG maximumTextCharacters = 0; // zero means unlimited
+    ULONGLONG maximumChunks = 0; // dito
+    ULONGLONG emittedTextCharacters = 0;
+    ULONGLONG emittedChunks = 0;
+    size_t nextNameOnlyItem = 0;
+    CachedChunk::IdMap nameOnlyIdMap; // stays empty, name chunks only reference themselves
 
     // shared between extractor and Windows thread, must not be synced
     std::mutex m;
     std::condition_variable cv;
     ULONG recursionDepth = 0;
+    std::optional<streams::MappedFile> mappedFile; // only set if the archive is read through a file mapping
+    std::optional<ArchiveSnapshot> snapshot; // taken by the extractor before any item gets queued
+    bool cacheChunkText = false; // set before Init by native callers that want views instead of GetText
 
     // shared between extractor and Windows thread, must be synced
-    std::list<ItemTask> tasks;
+    std::multimap<ULONGLONG, ItemTask> tasks; // ordered by priority, equal priorities keep their insertion order
+    std::vector<UINT32> nameOnlyItems; // append-only, items that only get a name chunk in extraction order (which follows their priority unless the archive is solid)
     bool extractionFinished;
     HRESULT extractionResult;
     bool abortExtraction;
 
     // used exclusively in the extractor thread
-    const Registrar registrar;
+    Registrar registrar; // compacted on Init
     std::optional<ItemTask> currentExtractTask;
+    sevenzip::ISequentialOutStreamPtr currentHeaderStream; // a streams::HeaderStream, only set while the first bytes of an item without a filter for its extension are collected
+    std::vector<BYTE> sniffedHeader; // reused by all header streams
+    std::vector<ULONGLONG> itemPriorities; // only filled if items are prioritized
+    std::vector<UINT32> extractionOrder; // only filled if the archive may be extracted out of order
+    std::vector<UINT32> duplicateGroups; // group of each item, MAXUINT32 if it has no duplicates, empty if not grouped
+    std::vector<std::optional<ItemTask>> groupOriginals; // the first extracted item of each group, if any yet
 
     // called from Windows thread (IFilter::Init, final IUnknown::Release)
     void AbortAnyExtractionOrTasksAndReset()
@@ -112,6 +161,7 @@ namespace com
         abortExtraction = false;
 
         // reset, no need to sync, but do it in a way that in theory IFilter::Get* can be called even after failure
+        currentChunk = std::nullopt; // the chunk's text is owned by its task
         if (currentChunkTask)
         {
             currentChunkTask->Abort();
@@ -119,28 +169,252 @@ namespace com
         }
         while (!tasks.empty())
         {
-            currentChunkTask = tasks.front();
-            tasks.pop_front();
+            currentChunkTask = tasks.begin()->second;
+            tasks.erase(tasks.begin());
             currentChunkTask->Abort();
             currentChunkTask = std::nullopt;
         }
-        currentChunk = std::nullopt;
+        nameOnlyItems.clear();
+        nextNameOnlyItem = 0;
         currentChunkId = 0;
     }
-    );
 
-    //----------------------------------------------------------------------------//
+    // called from extractor thread, or from Windows thread for queued items (their priorities don't change anymore)
+    ULONGLONG PriorityOf(UINT32 index) const noexcept
+    {
+        return index < itemPriorities.size() ? itemPriorities[index] : index;
+    }
 
-    static void EndExtractionTaskIfAny(std::optional<ItemTask>& task) // will not call COM
+    // called with m locked
+    bool HasTaskOrNameOnlyItem() const noexcept
     {
-        // end and clear the task if there is one
-        if (task)
+        return !tasks.empty() || nextNameOnlyItem < nameOnlyItems.size();
+    }
+
+    // called from Windows thread (IFilter::GetChunk)
+    bool IsOverBudget() const noexcept
+    {
+        return maximumChunks > 0 && emittedChunks >= maximumChunks || maximumTextCharacters > 0 && emittedTextCharacters >= maximumTextCharacters;
+    }
+
+    // called from Windows thread (IFilter::Init), prefers a file mapping over the stream
+    sevenzip::IInStreamPtr OpenInStream()
+    {
+        mappedFile = std::nullopt;
+        if (!fileName.empty())
         {
-            task->SetEndOfExtraction();
-            task = std::nullopt;
+            try
+            {
+                mappedFile = streams::MappedFile(std::filesystem::path(fileName));
+                return streams::MappedStream::CreateComInstance<sevenzip::IInStream>(*mappedFile);
+            }
+            catch (const std::system_error&) {} // e.g. empty or locked file, fall back to the stream
         }
+        return streams::BridgeStream::CreateComInstance<sevenzip::IInStream>(stream);
+    }
+
+    // called from Windows thread (IFilter::Init), falls back to the first bytes if the stream's extension is no known format
+    std::wstring FindArchiveExtension()
+    {
+        const auto description = FileDescription::FromIStream(stream);
+        if (archive::Factory::GetInstance().Formats.find(description.Extension) != nullptr || !settings::sniff_unknown_items()) { return std::wstring(description.Extension); }
+        const auto& sniffer = Sniffer::GetInstance();
+        auto header = std::vector<BYTE>(sniffer.HeaderSize);
+        auto length = ULONG(0);
+        COM_DO_OR_THROW(stream->Read(header.data(), static_cast<ULONG>(header.size()), &length));
+        COM_DO_OR_THROW(stream->Seek(LARGE_INTEGER(), STREAM_SEEK_SET, nullptr)); // rewind again
+        return std::wstring(sniffer.FindExtension(header.data(), length));
     }
 
+    // called from extractor thread, returns where a stored item's data starts within the mapped file
+    std::optional<ULONGLONG> FindStoredData(UINT32 index) const
+    {
+        // the reported offset differs between formats, so only trust it if it points to a known header of an uncompressed file
+        const auto headerOffset = snapshot->GetStoredOffset(index);
+        const auto size = snapshot->GetSize(index);
+        if (!mappedFile || headerOffset == MAXULONGLONG) { return std::nullopt; }
+        BYTE header[512];
+        auto dataOffset = ULONGLONG(0);
+        if (mappedFile->Read(headerOffset, header, 30) && header[0] == 'P' && header[1] == 'K' && header[2] == 3 && header[3] == 4)
+        {
+            // zip local file header without encryption (flag bit 0) and the store method
+            const auto flags = static_cast<UINT16>(header[6] | header[7] << 8);
+            const auto method = static_cast<UINT16>(header[8] | header[9] << 8);
+            if ((flags & 1) != 0 || method != 0) { return std::nullopt; }
+            dataOffset = headerOffset + 30 + static_cast<UINT16>(header[26] | header[27] << 8) + static_cast<UINT16>(header[28] | header[29] << 8);
+        }
+        else if (mappedFile->Read(headerOffset, header, sizeof(header)) && std::memcmp(header + 257, "ustar", 5) == 0)
+        {
+            // tar header of a regular file, which is directly followed by its data
+            if (header[156] != '0' && header[156] != '\0' && header[156] != '7') { return std::nullopt; }
+            dataOffset = headerOffset + sizeof(header);
+        }
+        else
+        {
+            return std::nullopt;
+        }
+        if (dataOffset > mappedFile->Size || size > mappedFile->Size - dataOffset) { return std::nullopt; }
+        return dataOffset;
+    }
+
+    // called from extractor thread, prefers smaller items if requested
+    void PrioritizeItems()
+    {
+        itemPriorities.clear();
+        extractionOrder.clear();
+        if (settings::extraction_order() != 1) { return; } // keep the archive order
+
+        // get the priority of all items, which is their size multiplied by the weight of their extension
+        const auto numItems = snapshot->Count;
+        auto weights = std::unordered_map<std::wstring, DWORD>();
+        itemPriorities.reserve(numItems);
+        for (auto i = UINT32(0); i < numItems; i++)
+        {
+            const auto description = FileDescription::FromArchiveItem(*snapshot, i);
+            auto priority = ULONGLONG(0); // directories are cheap
+            if (!description.IsDirectory)
+            {
+                const auto extension = utils::fold_extension(description.Extension);
+                auto weight = weights.find(extension);
+                if (weight == weights.end())
+                {
+                    weight = weights.emplace(extension, settings::extension_weight(extension)).first;
+                }
+                priority = !description.SizeIsValid || weight->second > 0 && description.Size > MAXULONGLONG / weight->second
+                    ? MAXULONGLONG
+                    : description.Size * weight->second / 100;
+            }
+            itemPriorities.push_back(priority);
+        }
+
+        // solid archives have to be decompressed in order, in which case only the queued tasks are reordered
+        auto solid = win32::propvariant();
+        COM_DO_OR_THROW(archive->GetArchiveProperty(sevenzip::PropertyId::Solid, &solid));
+        if (::PropVariantToBooleanWithDefault(solid, false)) { return; }
+        extractionOrder.resize(numItems);
+        std::iota(extractionOrder.begin(), extractionOrder.end(), UINT32(0));
+        std::stable_sort(extractionOrder.begin(), extractionOrder.end(), [this](UINT32 a, UINT32 b) { return itemPriorities[a] < itemPriorities[b]; });
+    }
+
+    // called from extractor thread, groups files that have the same content and would be filtered the same way
+    void GroupDuplicates()
+    {
+        duplicateGroups.clear();
+        groupOriginals.clear();
+        if (!settings::skip_duplicate_items()) { return; }
+
+        // the key includes the extension, since a different one might select another sub-filter
+        const auto numItems = snapshot->Count;
+        auto firstItems = std::map<std::tuple<ULONGLONG, ULONGLONG, std::wstring>, UINT32>();
+        duplicateGroups.resize(numItems, MAXUINT32);
+        for (auto i = UINT32(0); i < numItems; i++)
+        {
+            const auto crc = snapshot->GetCrc(i);
+            const auto size = snapshot->GetSize(i);
+            if (snapshot->IsDirectory(i) || crc == MAXULONGLONG || size == MAXULONGLONG) { continue; }
+            const auto [first, inserted] = firstItems.emplace(std::make_tuple(crc, size, utils::fold_extension(FileDescription::FromArchiveItem(*snapshot, i).Extension)), i);
+            if (inserted) { continue; }
+            if (duplicateGroups[first->second] == MAXUINT32)
+            {
+                // second item with that key, start a new group
+                duplicateGroups[first->second] = static_cast<UINT32>(groupOriginals.size());
+                groupOriginals.emplace_back();
+            }
+            duplicateGroups[i] = duplicateGroups[first->second];
+        }
+    }
+
+    // called from extractor thread, lists the item by name only, throws E_ABORT if the extraction got aborted
+    void QueueNameOnlyItem(UINT32 index)
+    {
+        auto wasEmpty = false;
+        {
+            const auto lock = std::lock_guard<std::mutex>(m);
+            if (abortExtraction) { COM_THROW(E_ABORT); } // stop the extraction as in StartTask
+            wasEmpty = !HasTaskOrNameOnlyItem();
+            nameOnlyItems.push_back(index);
+        }
+        if (wasEmpty)
+        {
+            cv.notify_all(); // let GetChunk know, it only waits while there is nothing queued
+        }
+        counters::increment(counters::counter::name_only_items);
+    }
+
+    // called from extractor thread, queues and runs a task for the item, returns the stream 7-Zip should write the item to (if any), throws E_ABORT if the extraction got aborted
+    sevenzip::ISequentialOutStreamPtr StartTask(UINT32 index, const FileDescription& description, const CLSID& clsid, bool isSniffed)
+    {
+        // create the current task
+        const auto group = index < duplicateGroups.size() ? duplicateGroups[index] : MAXUINT32;
+        const auto isDuplicate = group != MAXUINT32 && groupOriginals[group];
+        const auto storedData = isDuplicate ? std::optional<ULONGLONG>() : FindStoredData(index);
+        if (isDuplicate)
+        {
+            currentExtractTask = groupOriginals[group]->Replicate(description);
+        }
+        else
+        {
+            currentExtractTask = ItemTask(description);
+            if (cacheChunkText)
+            {
+                currentExtractTask->CacheText();
+            }
+            if (isSniffed)
+            {
+                currentExtractTask->IgnoreFilterErrors(); // the item might just look like something else
+            }
+            if (group != MAXUINT32)
+            {
+                // first item of its group, keep its chunks for the others
+                currentExtractTask->Record();
+                groupOriginals[group] = currentExtractTask;
+            }
+        }
+
+        // limit concurrency and enqueue the task
+        {
+            auto lock = std::unique_lock<std::mutex>(m);
+            cv.wait(lock, [this] { return tasks.size() <= settings::concurrent_filter_threads() || abortExtraction; });
+            if (abortExtraction) { COM_THROW(E_ABORT); } // this will abort the entire extraction, not just the current entry
+            tasks.emplace(PriorityOf(index), *currentExtractTask);
+        }
+        cv.notify_all(); // let GetChunk know
+
+        // start the task (needs to be after enqueue to ensure ItemTask::Abort will get called if necessary)
+        if (isDuplicate)
+        {
+            // nothing to filter, the replica gets its chunks from the original, so 7-Zip can skip the item
+            EndExtractionTaskIfAny(currentExtractTask);
+            counters::increment(counters::counter::duplicate_items_replayed);
+            return nullptr;
+        }
+        if (storedData)
+        {
+            // the sub-filter reads straight from the archive, so 7-Zip can skip the item
+            currentExtractTask->Run(*attributes, clsid, recursionDepth, archiveDeadline, &*mappedFile, *storedData);
+            EndExtractionTaskIfAny(currentExtractTask);
+            counters::increment(counters::counter::stored_items_read_directly);
+            return nullptr;
+        }
+        return currentExtractTask->Run(*attributes, clsid, recursionDepth, archiveDeadline);
+    }
+
+    // called from extractor thread, hands the first bytes of an item that was still being sniffed on and ends the item's task, will not throw
+    void EndCurrentItem() noexcept
+    {
+        if (currentHeaderStream)
+        {
+            try
+            {
+                static_cast<streams::HeaderStream*>(currentHeaderStream.GetInterfacePtr())->Flush(); // the item was shorter than the header
+            }
+            catch (...) {} // e.g. aborted, the item simply doesn't show up
+            currentHeaderStream = nullptr;
+        }
+        EndExtractionTaskIfAny(currentExtractTask);
+    }
+    );
+
     //----------------------------------------------------------------------------//
 
     Filter::Filter() : PIMPL_INIT() {}
@@ -156,29 +430,66 @@ namespace com
 
         // prerequisites
         PIMPL_(AbortAnyExtractionOrTasksAndReset)(); // Init method might be called multiple times, so stop any running extraction
+        PIMPL_(registrar) = PIMPL_(registrar).Compact(); // the previous extraction's lookups can be read without locking from now on
         COM_DO_OR_RETURN(PIMPL_(stream)->Seek(LARGE_INTEGER(), STREAM_SEEK_SET, nullptr)); // rewind the stream (necessary for iFiltTst)
 
-        // capture the attributes and open the archive
+        // split the budget: half of it (up to ConcurrentFilterThreads) runs the sub-filters, the decoders of all archives share the rest
+        const auto threadBudget = settings::thread_budget();
+        const auto jobThreads = std::max(std::min(settings::concurrent_filter_threads(), threadBudget / 2), DWORD(1));
+        const auto decoderBudget = threadBudget > jobThreads ? threadBudget - jobThreads : 0;
+        threads::limit_jobs(jobThreads);
+
+        // capture the attributes and open the archive (its decoder gets the extractor thread, which stands in for the waiting Windows thread, and whatever is left of its share)
         PIMPL_(attributes) = FilterAttributes(grfFlags, cAttributes, aAttributes);
-        PIMPL_(archive) = archive::Factory::CreateArchiveFromExtension(FileDescription::FromIStream(PIMPL_(stream)).Extension);
+        PIMPL_(archive) = nullptr; // release the previous archive before its module
+        auto decoderThreads = threads::reservation(decoderBudget, decoderBudget);
+        PIMPL_(archive) = archive::Factory::CreateArchiveFromExtension(PIMPL_(FindArchiveExtension)(), PIMPL_(archiveUsage), 1 + decoderThreads.count());
         const auto scanSize = UINT64(1 << 23); // taken from 7-Zip source
-        COM_DO_OR_RETURN(PIMPL_(archive)->Open(streams::BridgeStream::CreateComInstance<sevenzip::IInStream>(PIMPL_(stream)), &scanSize, nullptr));
+        COM_DO_OR_RETURN(PIMPL_(archive)->Open(PIMPL_(OpenInStream)(), &scanSize, nullptr));
+
+        // calculate the deadline for the entire archive
+        const auto timeLimit = settings::archive_time_limit();
+        PIMPL_(archiveDeadline) = std::nullopt;
+        if (timeLimit > 0)
+        {
+            PIMPL_(archiveDeadline) = std::chrono::steady_clock::now() + std::chrono::seconds(timeLimit);
+        }
+
+        // reset the text budget (nested archives count towards their parent's budget as well)
+        PIMPL_(maximumTextCharacters) = settings::maximum_text_characters();
+        PIMPL_(maximumChunks) = settings::maximum_chunks();
+        PIMPL_(emittedTextCharacters) = 0;
+        PIMPL_(emittedChunks) = 0;
 
         // start the extractor thread
         PIMPL_(extractionFinished) = false; // no need to sync yet
         PIMPL_(extractionResult) = S_OK;
-        PIMPL_(extractor) = std::thread([PIMPL_CAPTURE, callback = this]() -> void
+        PIMPL_(extractor) = std::thread([PIMPL_CAPTURE, callback = this, decoderThreads = std::move(decoderThreads)]() -> void
         {
             COM_THREAD_BEGIN(COINITBASE_MULTITHREADED);
 
-            // extract everything and close the archive
-            COM_DO_OR_THROW(PIMPL_(archive)->Extract(nullptr, MAXUINT32, 0, &ExtractCallbackForwarder(callback)));
+            // extract everything (7-Zip expects sorted indices, so extract one by one if prioritized) and close the archive
+            PIMPL_(snapshot) = ArchiveSnapshot(PIMPL_(archive), PIMPL_(mappedFile) && settings::read_stored_items_directly(), settings::skip_duplicate_items());
+            PIMPL_(PrioritizeItems)();
+            PIMPL_(GroupDuplicates)();
+            if (PIMPL_(extractionOrder).empty())
+            {
+                COM_DO_OR_THROW(PIMPL_(archive)->Extract(nullptr, MAXUINT32, 0, &ExtractCallbackForwarder(callback)));
+            }
+            else
+            {
+                for (const auto index : PIMPL_(extractionOrder))
+                {
+                    COM_DO_OR_THROW(PIMPL_(archive)->Extract(&index, 1, 0, &ExtractCallbackForwarder(callback)));
+                }
+            }
             COM_DO_OR_THROW(PIMPL_(archive)->Close());
 
             COM_THREAD_END(PIMPL_(extractionResult));
+            PIMPL_(groupOriginals).clear(); // the queued tasks keep the originals alive as long as needed
 
             // necessary if 7-Zip formats don't call SetOperationResult, this must succeed to avoid deadlocks
-            EndExtractionTaskIfAny(PIMPL_(currentExtractTask)); // will not call COM
+            PIMPL_(EndCurrentItem)(); // will not call COM outside of this DLL
 
             // signal finished
             PIMPL_LOCK_BEGIN(m);
@@ -192,28 +503,67 @@ namespace com
     }
 
     STDMETHODIMP_(SCODE) Filter::GetChunk(STAT_CHUNK* pStat) noexcept // called from Windows thread
+    {
+        COM_CHECK_POINTER(pStat);
+        const auto hr = MoveToNextChunk();
+        if (FAILED(hr)) { return hr; }
+        return PIMPL_(currentChunk)->GetChunk(pStat);
+    }
+
+    SCODE Filter::MoveToNextChunk() noexcept // called from Windows thread
     {
         COM_NOTHROW_BEGIN;
+        auto nameOnlyItem = UINT32(0);
 
+        // stop before waiting for anything once the budget is used up, so the extractor gets aborted right away
+        if (PIMPL_(IsOverBudget)()) { goto over_budget; }
         if (!PIMPL_(currentChunkTask))
         {
         get_next_task:
             PIMPL_LOCK_BEGIN(m);
-            PIMPL_WAIT(m, cv, !PIMPL_(tasks).empty() || PIMPL_(extractionFinished));
-            if (PIMPL_(tasks).empty()) { goto finished; } // all done, nothing more to come, need to exit lock
-            PIMPL_(currentChunkTask) = PIMPL_(tasks).front();
-            PIMPL_(tasks).pop_front();
+            if (!PIMPL_(archiveDeadline))
+            {
+                PIMPL_WAIT(m, cv, PIMPL_(HasTaskOrNameOnlyItem)() || PIMPL_(extractionFinished));
+            }
+            else if (!PIMPL_WAIT_UNTIL(m, cv, *PIMPL_(archiveDeadline), PIMPL_(HasTaskOrNameOnlyItem)() || PIMPL_(extractionFinished)) || std::chrono::steady_clock::now() >= *PIMPL_(archiveDeadline))
+            {
+                goto timed_out; // need to exit lock
+            }
+            if (!PIMPL_(HasTaskOrNameOnlyItem)()) { goto finished; } // all done, nothing more to come, need to exit lock
+            if (PIMPL_(nextNameOnlyItem) < PIMPL_(nameOnlyItems).size())
+            {
+                // merge the name-only items with the tasks, names go first on equal priorities
+                const auto candidate = PIMPL_(nameOnlyItems)[PIMPL_(nextNameOnlyItem)];
+                if (PIMPL_(tasks).empty() || PIMPL_(PriorityOf)(candidate) <= PIMPL_(tasks).begin()->first)
+                {
+                    nameOnlyItem = candidate;
+                    PIMPL_(nextNameOnlyItem)++;
+                    goto name_only; // need to exit lock
+                }
+            }
+            PIMPL_(currentChunkTask) = PIMPL_(tasks).begin()->second; // task with the highest priority
+            PIMPL_(tasks).erase(PIMPL_(tasks).begin());
             PIMPL_LOCK_END;
             PIMPL_(cv).notify_all(); // notify extractor that another task may be queued
         }
+        PIMPL_(currentChunk) = std::nullopt; // release the previous chunk first, its pipe might block the gatherer
         PIMPL_(currentChunk) = PIMPL_(currentChunkTask)->NextChunk(++PIMPL_(currentChunkId));
         if (!PIMPL_(currentChunk))
         {
-            // this item is done, fetch the next
+            // this item is done, fetch the next (the current chunk is already reset, so its text may be released)
             PIMPL_(currentChunkTask) = std::nullopt;
             goto get_next_task;
         }
-        return PIMPL_(currentChunk)->GetChunk(pStat);
+        PIMPL_(emittedChunks)++;
+        return S_OK;
+
+    name_only:
+        // the name is a view into the snapshot, which lives until the next Init
+        PIMPL_(currentChunk) = std::nullopt;
+        PIMPL_(currentChunk) = CachedChunk::FromName(PIMPL_(snapshot)->GetName(nameOnlyItem));
+        PIMPL_(currentChunk)->Map(++PIMPL_(currentChunkId), PIMPL_(nameOnlyIdMap));
+        PIMPL_(emittedChunks)++;
+        return S_OK;
 
     finished:
         PIMPL_(currentChunk) = std::nullopt; // should already be the case
@@ -229,12 +579,41 @@ namespace com
         }
         return FILTER_E_END_OF_CHUNKS;
 
+    timed_out:
+        PIMPL_(AbortAnyExtractionOrTasksAndReset)(); // tasks are past their deadline as well, so this won't block on sub-filters
+        PIMPL_(extractionResult) = S_OK; // the extraction got aborted on purpose
+        return FILTER_E_END_OF_CHUNKS;
+
+    over_budget:
+        if (PIMPL_(recursionDepth) == 0) { counters::increment(counters::counter::archives_over_budget); } // nested archives are part of their parent's budget
+        PIMPL_(AbortAnyExtractionOrTasksAndReset)(); // gatherers stop at their next chunk
+        PIMPL_(extractionResult) = S_OK; // dito
+        return FILTER_E_END_OF_CHUNKS;
+
         COM_NOTHROW_END;
     }
 
     STDMETHODIMP_(SCODE) Filter::GetText(ULONG* pcwcBuffer, WCHAR* awcBuffer) noexcept // called from Windows thread
     {
-        return PIMPL_(currentChunk) ? PIMPL_(currentChunk)->GetText(pcwcBuffer, awcBuffer) : FILTER_E_NO_MORE_TEXT;
+        if (!PIMPL_(currentChunk)) { return FILTER_E_NO_MORE_TEXT; }
+        COM_CHECK_POINTER(pcwcBuffer);
+
+        // truncate the text at the end of the budget, GetChunk ends the archive afterwards
+        if (PIMPL_(maximumTextCharacters) > 0)
+        {
+            if (PIMPL_(emittedTextCharacters) >= PIMPL_(maximumTextCharacters)) { return FILTER_E_NO_MORE_TEXT; }
+            const auto remaining = PIMPL_(maximumTextCharacters) - PIMPL_(emittedTextCharacters);
+            if (*pcwcBuffer > remaining + 1) // plus one for the null terminator
+            {
+                *pcwcBuffer = static_cast<ULONG>(remaining + 1);
+            }
+        }
+        const auto hr = PIMPL_(currentChunk)->GetText(pcwcBuffer, awcBuffer);
+        if (SUCCEEDED(hr))
+        {
+            PIMPL_(emittedTextCharacters) += *pcwcBuffer;
+        }
+        return hr;
     }
 
     STDMETHODIMP_(SCODE) Filter::GetValue(PROPVARIANT** ppPropValue) noexcept // called from Windows thread
@@ -252,6 +631,7 @@ namespace com
         COM_CHECK_ARG(grfMode == STGM_READ || grfMode == STGM_READWRITE);
         if (PIMPL_(stream)) { return HRESULT_FROM_WIN32(ERROR_ALREADY_INITIALIZED); } // according to docs
         PIMPL_(stream) = pstream; // will call AddRef
+        PIMPL_(fileName).clear();
         return S_OK;
     }
 
@@ -271,6 +651,7 @@ namespace com
     {
         COM_CHECK_POINTER(pStm);
         PIMPL_(stream) = pStm; // will call AddRef and release the old one
+        PIMPL_(fileName).clear();
         return S_OK;
     }
 
@@ -283,7 +664,15 @@ namespace com
     STDMETHODIMP Filter::Load(LPCOLESTR pszFileName, DWORD dwMode) noexcept // called from Windows thread
     {
 #pragma comment(lib, "Shlwapi")
-        return ::SHCreateStreamOnFileEx(pszFileName, dwMode, FILE_ATTRIBUTE_READONLY, false, nullptr, &PIMPL_(stream));
+        COM_CHECK_POINTER(pszFileName);
+        COM_NOTHROW_BEGIN;
+
+        // the stream is still needed for the description, the name allows reading the archive through a file mapping
+        COM_DO_OR_RETURN(::SHCreateStreamOnFileEx(pszFileName, dwMode, FILE_ATTRIBUTE_READONLY, false, nullptr, &PIMPL_(stream)));
+        PIMPL_(fileName).assign(pszFileName);
+        return S_OK;
+
+        COM_NOTHROW_END;
     }
 
     STDMETHODIMP Filter::Save(LPCOLESTR pszFileName, BOOL fRemember) noexcept { return E_NOTIMPL; } // see iFilter docs
@@ -296,7 +685,17 @@ namespace com
 
     STDMETHODIMP Filter::SetTotal(UINT64 total) noexcept { return S_OK; } // no status needed
 
-    STDMETHODIMP Filter::SetCompleted(const UINT64* completeValue) noexcept { return S_OK; } // no status needed
+    STDMETHODIMP Filter::SetCompleted(const UINT64* completeValue) noexcept // called from extraction thread
+    {
+        COM_NOTHROW_BEGIN;
+
+        // no status needed, but use the progress to stop long decompressions early
+        PIMPL_LOCK_BEGIN(m);
+        return PIMPL_(abortExtraction) ? E_ABORT : S_OK;
+        PIMPL_LOCK_END;
+
+        COM_NOTHROW_END;
+    }
 
     STDMETHODIMP Filter::GetStream(UINT32 index, sevenzip::ISequentialOutStream** outStream, sevenzip::AskMode askExtractMode) noexcept // called from extraction thread
     {
@@ -306,20 +705,33 @@ namespace com
         auto streamPtr = sevenzip::ISequentialOutStreamPtr(); // reserve the com pointer and enter nothrow
         COM_NOTHROW_BEGIN;
 
-        // end any pending task and create the current one
-        EndExtractionTaskIfAny(PIMPL_(currentExtractTask));
-        PIMPL_(currentExtractTask) = ItemTask(FileDescription::FromArchiveItem(PIMPL_(archive), index));
-
-        // limit concurrency and enqueue the task
-        PIMPL_LOCK_BEGIN(m);
-        PIMPL_WAIT(m, cv, PIMPL_(tasks).size() <= settings::concurrent_filter_threads() || PIMPL_(abortExtraction));
-        if (PIMPL_(abortExtraction)) { return E_ABORT; } // this will abort the entire extraction, not just the current entry
-        PIMPL_(tasks).push_back(*PIMPL_(currentExtractTask));
-        PIMPL_LOCK_END;
-        PIMPL_(cv).notify_all(); // let GetChunk know
+        // end any pending item
+        PIMPL_(EndCurrentItem)();
+        const auto description = FileDescription::FromArchiveItem(*PIMPL_(snapshot), index);
 
-        // start the task (needs to be after enqueue to ensure ItemTask::Abort will get called if necessary)
-        streamPtr = PIMPL_(currentExtractTask)->Run(*PIMPL_(attributes), PIMPL_(registrar), PIMPL_(recursionDepth));
+        // items without a filter for their extension are either sniffed (still without a task) or only listed by name, without a concurrency slot but in their usual order
+        auto sniff = false;
+        const auto clsid = ItemTask::FindClsid(description, PIMPL_(registrar), PIMPL_(recursionDepth), sniff);
+        if (clsid)
+        {
+            streamPtr = PIMPL_(StartTask)(index, description, *clsid, false);
+        }
+        else if (sniff)
+        {
+            // the first bytes decide, either the item is filtered after all or it only gets its name and the rest is dropped
+            streamPtr = streams::HeaderStream::CreateComInstance<sevenzip::ISequentialOutStream>(PIMPL_(sniffedHeader), Sniffer::GetInstance().HeaderSize, [PIMPL_CAPTURE, index, description](const BYTE* header, ULONG length) -> sevenzip::ISequentialOutStreamPtr
+            {
+                const auto sniffedClsid = ItemTask::SniffClsid(header, length, PIMPL_(registrar), PIMPL_(recursionDepth));
+                if (sniffedClsid) { return PIMPL_(StartTask)(index, description, *sniffedClsid, true); }
+                PIMPL_(QueueNameOnlyItem)(index);
+                return nullptr;
+            });
+            PIMPL_(currentHeaderStream) = streamPtr;
+        }
+        else
+        {
+            PIMPL_(QueueNameOnlyItem)(index); // outStream stays null, so 7-Zip skips the item
+        }
 
         // leave nothrow and return the pointer
         COM_NOTHROW_END;
@@ -339,6 +751,34 @@ namespace com
         return S_OK;
     }
 
+    //----------------------------------------------------------------------------//
+
+    void Filter::CacheChunkText() noexcept // called from native caller before Init
+    {
+        PIMPL_(cacheChunkText) = true;
+    }
+
+    const CachedChunk* Filter::NextChunk(std::wstring_view& text) // called from native caller (acting as Windows thread)
+    {
+        text = std::wstring_view();
+        const auto hr = MoveToNextChunk();
+        if (hr == FILTER_E_END_OF_CHUNKS) { return nullptr; }
+        COM_DO_OR_THROW(hr);
+
+        // the view counts towards the same budget as GetText and gets truncated at its end
+        text = PIMPL_(currentChunk)->UnreadText;
+        if (PIMPL_(maximumTextCharacters) > 0)
+        {
+            const auto remaining = PIMPL_(emittedTextCharacters) < PIMPL_(maximumTextCharacters) ? PIMPL_(maximumTextCharacters) - PIMPL_(emittedTextCharacters) : 0;
+            if (text.length() > remaining)
+            {
+                text = text.substr(0, static_cast<size_t>(remaining));
+            }
+        }
+        PIMPL_(emittedTextCharacters) += text.length();
+        return &*PIMPL_(currentChunk);
+    }
+
     /******************************************************************************/
 
     CLASS_IMPLEMENTATION(FilterAttributes,
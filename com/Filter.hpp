@@ -22,6 +22,10 @@
 #include "pimpl.hpp"
 #include "sevenzip.hpp"
 
+#include "CachedChunk.hpp"
+
+#include <string_view>
+
 namespace com
 {
     struct DECLSPEC_UUID("E22C9972-6449-4137-BA03-D75B570A0251") IFilter4Archives; // allows communication between different filter instances
@@ -69,6 +73,12 @@ namespace com
     STDMETHOD(SetOperationResult)(sevenzip::OperationResult opRes) noexcept override; // IArchiveExtractCallback
 
     STDMETHOD(SetRecursionDepth)(ULONG depth) noexcept override; // IFilter4Archives
+
+    void CacheChunkText() noexcept; // chunks keep their text instead of piping it, must be called before Init
+    const CachedChunk* NextChunk(std::wstring_view& text); // GetChunk without copies, text is the chunk's unread text within the budget, nullptr after the last chunk
+
+private:
+    SCODE MoveToNextChunk() noexcept; // leaves the next chunk in currentChunk on success
     );
 
     /******************************************************************************/
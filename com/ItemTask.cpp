@@ -18,99 +18,281 @@
 
 #include "ItemTask.hpp"
 
+#include "counters.hpp"
 #include "settings.hpp"
+#include "threads.hpp"
 
 #include "ReadStream.hpp"
+#include "Sniffer.hpp"
 #include "WriteStream.hpp"
 
 #include <atomic>
 #include <condition_variable>
 #include <list>
 #include <mutex>
-#include <thread>
+#include <vector>
 
 namespace com
 {
+    static std::optional<CLSID> LimitRecursion(const std::optional<CLSID>& clsid, ULONG recursionDepth)
+    {
+        if (clsid && *clsid == __uuidof(Filter) && recursionDepth >= settings::recursion_depth_limit()) { return std::nullopt; }
+        return clsid;
+    }
+
     CLASS_IMPLEMENTATION(ItemTask,
                          PIMPL_CONSTRUCTOR(const FileDescription& description) : description(description) {}
 public:
     const FileDescription description;
+    TextArena arena; // holds the text of all chunks, so chunks must not outlive the task
     std::mutex m;
     std::condition_variable cv;
     std::list<CachedChunk> chunks;
     CachedChunk::IdMap idMap;
     std::optional<streams::FileBuffer> buffer;
-    std::thread gatherer;
     HRESULT result = S_OK;
     bool isExtractionDone = false;
     bool wasFilterStarted = false;
     bool isFilterDone = false;
+    bool timedOut = false;
+    bool isGathering = false; // a job on the executor runs the sub-filter
+    bool isCompensated = false; // the executor got an extra thread while the gathering job blocks or is abandoned
+    Deadline archiveDeadline; // applies until the sub-filter starts
+    Deadline deadline; // set once the sub-filter starts, never exceeds the archive's
+    std::optional<TextPipe> pipe; // the one currently being filled by the gatherer
     std::atomic<bool> aborted = false;
+    std::atomic<bool> isConsumed = false; // NextChunk got called, so piped text is going to be read
+    bool isRecording = false;
+    bool isCachingText = false;
+    bool isIgnoringErrors = false;
+    std::vector<CachedChunk> recording; // copies of all gathered chunks, only if recording
+    std::optional<ItemTask> original; // only set for replicas
+    size_t replayedChunks = 0;
+
+    // called with m locked
+    bool HasChunkOrIsDone() const noexcept
+    {
+        return !chunks.empty() || isFilterDone && (isExtractionDone || timedOut);
+    }
+
+    // called from the gathering job, the result is dropped if the task has already been abandoned
+    void SetFilterDone(HRESULT filterResult)
+    {
+        {
+            const auto lock = std::lock_guard(m);
+            if (!timedOut)
+            {
+                result = filterResult;
+                isFilterDone = true;
+            }
+            isGathering = false;
+            if (isCompensated)
+            {
+                threads::end_blocking();
+                isCompensated = false;
+            }
+        }
+        cv.notify_all();
+    }
+
+    // called with m locked, lets the executor run other jobs while the gathering one waits on something outside of it
+    void Compensate() noexcept
+    {
+        if (isGathering && !isCompensated)
+        {
+            threads::begin_blocking();
+            isCompensated = true;
+        }
+    }
+
+    // called with m locked, lets an overdue sub-filter run on its own and reports the item as timed out
+    void Abandon()
+    {
+        aborted = true;
+        timedOut = true;
+        isFilterDone = true;
+        result = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+        if (pipe)
+        {
+            pipe->Cancel();
+        }
+        Compensate(); // the job holds its own reference to this impl, but shouldn't hold up others
+    }
     );
 
     ItemTask::ItemTask(const FileDescription& description) : PIMPL_INIT(description)
     {
-        PIMPL_(chunks).push_back(CachedChunk::FromFileDescription(description)); // first chunk will be the file name
+        PIMPL_(chunks).push_back(CachedChunk::FromFileDescription(description, PIMPL_(arena))); // first chunk will be the file name
     }
 
+    ItemTask::ItemTask(std::shared_ptr<impl>&& sharedImpl) noexcept : pImpl(std::move(sharedImpl)) {}
+
     void ItemTask::Abort()
     {
-        // signal abort and wait for the thread to end
+        // signal abort and wait for the gathering job to end, but not beyond the deadline (a job that hasn't started yet sees the abort)
         PIMPL_(aborted) = true;
-        if (PIMPL_(gatherer).joinable())
+        PIMPL_LOCK_BEGIN(m);
+        if (PIMPL_(pipe))
         {
-            PIMPL_(gatherer).join();
+            PIMPL_(pipe)->Cancel(); // the gatherer might wait for the text to be read
         }
+        if (!PIMPL_(deadline))
+        {
+            PIMPL_WAIT(m, cv, !PIMPL_(isGathering));
+        }
+        else if (!PIMPL_WAIT_UNTIL(m, cv, *PIMPL_(deadline), !PIMPL_(isGathering)))
+        {
+            PIMPL_(Abandon)();
+        }
+        PIMPL_LOCK_END;
     }
 
     std::optional<CachedChunk> ItemTask::NextChunk(ULONG id)
     {
-        // needs to join gatherer on final block!
+        // replicas only have their name chunk, the rest comes from the original
+        if (PIMPL_(original) && PIMPL_(chunks).empty())
+        {
+            auto result = PIMPL_(original)->ReplayChunk(PIMPL_(replayedChunks));
+            if (!result) { return std::nullopt; }
+            PIMPL_(replayedChunks)++;
+            result->Map(id, PIMPL_(idMap));
+            return result;
+        }
+
+        // from now on piped text gets read
+        PIMPL_(isConsumed) = true;
         PIMPL_LOCK_BEGIN(m);
-        PIMPL_WAIT(m, cv, !PIMPL_(chunks).empty() || PIMPL_(isFilterDone) && PIMPL_(isExtractionDone));
+        while (!PIMPL_(HasChunkOrIsDone)())
+        {
+            // only the archive's deadline applies while the item waits for the executor, the item's once its sub-filter runs
+            const auto isGathering = PIMPL_(isGathering);
+            const auto deadline = isGathering ? PIMPL_(deadline) : PIMPL_(archiveDeadline);
+            if (!deadline)
+            {
+                PIMPL_WAIT(m, cv, PIMPL_(HasChunkOrIsDone)() || PIMPL_(isGathering) != isGathering);
+            }
+            else if (!PIMPL_WAIT_UNTIL(m, cv, *deadline, PIMPL_(HasChunkOrIsDone)() || PIMPL_(isGathering) != isGathering))
+            {
+                PIMPL_(Abandon)();
+            }
+        }
         if (!PIMPL_(chunks).empty())
         {
             // dequeue the chunk
-            auto result = PIMPL_(chunks).front();
-            result.Map(id, PIMPL_(idMap));
+            auto result = std::move(PIMPL_(chunks).front());
             PIMPL_(chunks).pop_front();
-            return result;
+            result.Map(id, PIMPL_(idMap));
+            return std::move(result); // into the optional
         }
         PIMPL_LOCK_END;
 
         // everything has been extracted and gathered, check if an error occurred
-        if (FAILED(PIMPL_(result)))
+        if (FAILED(PIMPL_(result)) && !PIMPL_(isIgnoringErrors))
         {
             // return an error chunk and clear the error
             auto result = CachedChunk::FromHResult(PIMPL_(result));
             result.Map(id, PIMPL_(idMap));
             PIMPL_(result) = S_OK;
-            return result;
+            return std::move(result); // dito
         }
+        return std::nullopt;
+    }
+
+    void ItemTask::CacheText()
+    {
+        PIMPL_(isCachingText) = true;
+    }
+
+    void ItemTask::IgnoreFilterErrors()
+    {
+        PIMPL_(isIgnoringErrors) = true;
+    }
+
+    void ItemTask::Record()
+    {
+        PIMPL_(isRecording) = true;
+    }
 
-        // wait for the thread and return
-        if (PIMPL_(gatherer).joinable())
+    ItemTask ItemTask::Replicate(const FileDescription& description) const
+    {
+        auto replica = ItemTask(description);
+        replica.PIMPL_(original) = *this;
+        return replica;
+    }
+
+    std::optional<CachedChunk> ItemTask::ReplayChunk(size_t index) const
+    {
+        // wait until the chunk has been gathered, the gatherer is done or the deadline has passed
+        PIMPL_LOCK_BEGIN(m);
+        const auto isAvailableOrDone = [&] { return index < PIMPL_(recording).size() || PIMPL_(isFilterDone); };
+        while (!isAvailableOrDone())
         {
-            PIMPL_(gatherer).join();
+            // the same deadlines as in NextChunk
+            const auto isGathering = PIMPL_(isGathering);
+            const auto deadline = isGathering ? PIMPL_(deadline) : PIMPL_(archiveDeadline);
+            if (!deadline)
+            {
+                PIMPL_WAIT(m, cv, isAvailableOrDone() || PIMPL_(isGathering) != isGathering);
+            }
+            else if (!PIMPL_WAIT_UNTIL(m, cv, *deadline, isAvailableOrDone() || PIMPL_(isGathering) != isGathering))
+            {
+                return std::nullopt; // whoever waits on the original abandons it
+            }
         }
-        return std::nullopt;
+        if (index >= PIMPL_(recording).size()) { return std::nullopt; }
+        return PIMPL_(recording)[index].Replay();
+        PIMPL_LOCK_END;
     }
 
-    sevenzip::ISequentialOutStreamPtr ItemTask::Run(const FilterAttributes& attributes, const Registrar& registrar, ULONG recursionDepth)
+    sevenzip::ISequentialOutStreamPtr ItemTask::Run(const FilterAttributes& attributes, const CLSID& clsid, ULONG recursionDepth, const Deadline& archiveDeadline, const streams::MappedFile* source, ULONGLONG sourceOffset)
     {
-        // preliminary checks on the file type
-        if (PIMPL_(description).IsDirectory) { return nullptr; } // only handle files
-        if (!PIMPL_(description).SizeIsValid || PIMPL_(description).Size > settings::maximum_file_size()) { return nullptr; } // file size unknown or too large
-        const auto clsid = registrar.FindClsid(PIMPL_(description).Extension);
-        if (!clsid) { return nullptr; } // no filter available
-        if (*clsid == __uuidof(Filter) && recursionDepth >= settings::recursion_depth_limit()) { return nullptr; } // limit recursion
-
         PIMPL_LOCK_BEGIN(m);
         if (PIMPL_(wasFilterStarted) || PIMPL_(isFilterDone)) { return nullptr; } // Run and/or SetEndOfExtraction already called
+        PIMPL_(description).LoadTimes(); // only now that the item is going to be filtered
+
+        // the item's own deadline only starts with its sub-filter
+        PIMPL_(archiveDeadline) = archiveDeadline;
+
+        // allocate the buffer
+        PIMPL_(buffer) = source != nullptr ? streams::FileBuffer(PIMPL_(description), *source, sourceOffset) : streams::FileBuffer(PIMPL_(description));
+        PIMPL_(wasFilterStarted) = true; // set the start flag
+        PIMPL_LOCK_END;
+
+        // gather once the whole item is readable (its last byte), so that the job never waits for the decoder, and only while someone still wants the chunks
+        auto gatherer = threads::job([weakImpl = std::weak_ptr<impl>(pImpl), attributes, clsid, recursionDepth, streamText = settings::stream_chunk_text() && !PIMPL_(isRecording) && !PIMPL_(isCachingText)]() -> void
+        {
+            auto sharedImpl = weakImpl.lock();
+            if (sharedImpl) { ItemTask(std::move(sharedImpl)).Gather(attributes, clsid, recursionDepth, streamText); }
+        });
+        PIMPL_(buffer)->WhenReadable(PIMPL_(description).Size > 0 ? PIMPL_(description).Size - 1 : 0, 1, std::move(gatherer));
+
+        // return the write stream, unless the buffer is already complete
+        if (source != nullptr) { return nullptr; }
+        return streams::WriteStream::CreateComInstance<sevenzip::ISequentialOutStream>(*PIMPL_(buffer));
+    }
 
-        // allocate the buffer and start the gatherer
-        PIMPL_(buffer) = streams::FileBuffer(PIMPL_(description));
-        PIMPL_(gatherer) = std::thread([attributes, filterClsid = *clsid, recursionDepth, PIMPL_CAPTURE]() -> void
+    void ItemTask::Gather(const FilterAttributes& attributes, const CLSID& filterClsid, ULONG recursionDepth, bool streamText)
+    {
+        // nothing to do if the task got aborted meanwhile, otherwise the item's deadline starts now (but must never exceed the archive's)
+        auto isGathering = false;
+        PIMPL_LOCK_BEGIN(m);
+        isGathering = PIMPL_(isGathering) = !PIMPL_(aborted);
+        if (isGathering)
+        {
+            const auto timeLimit = settings::item_time_limit();
+            if (timeLimit > 0)
+            {
+                PIMPL_(deadline) = std::chrono::steady_clock::now() + std::chrono::seconds(timeLimit);
+            }
+            if (PIMPL_(archiveDeadline) && (!PIMPL_(deadline) || *PIMPL_(archiveDeadline) < *PIMPL_(deadline)))
+            {
+                PIMPL_(deadline) = PIMPL_(archiveDeadline);
+            }
+        }
+        PIMPL_LOCK_END;
+        PIMPL_(cv).notify_all(); // let NextChunk know about the deadline
+        auto filterResult = S_OK;
+        if (isGathering)
         {
             COM_THREAD_BEGIN(COINIT_MULTITHREADED);
 
@@ -135,36 +317,50 @@ namespace com
                 auto filter4Archives = IFilter4ArchivesPtr();
                 COM_DO_OR_THROW(filter->QueryInterface<IFilter4Archives>(&filter4Archives));
                 COM_DO_OR_THROW(filter4Archives->SetRecursionDepth(recursionDepth));
+
+                // a nested archive waits for its own extractor and gathering jobs, which must not wait for this one
+                PIMPL_LOCK_BEGIN(m);
+                PIMPL_(Compensate)();
+                PIMPL_LOCK_END;
             }
             COM_DO_OR_THROW(attributes.Init(filter));
 
             // query all chunks (unless the task got aborted)
             while (!PIMPL_(aborted))
             {
-                auto chunk = CachedChunk::FromFilter(filter);
+                // only pipe the text if it's going to be read, a job must not wait for a consumer busy with another item
+                auto pipe = streamText && PIMPL_(isConsumed) ? std::make_optional<TextPipe>(PIMPL_(deadline)) : std::nullopt;
+                auto chunk = CachedChunk::FromFilter(filter, PIMPL_(arena), pipe ? &*pipe : nullptr);
                 if (FAILED(chunk.Code)) { break; } // Windows kills us if we report any error, do the same with the sub-filter
+                const auto isPiped = chunk.IsPiped;
 
-                // enqueue the chunk
+                // enqueue the chunk (without keeping a reference, so that dropping it cancels the pipe)
                 PIMPL_LOCK_BEGIN(m);
-                PIMPL_(chunks).push_back(chunk);
+                if (PIMPL_(isRecording))
+                {
+                    PIMPL_(recording).push_back(chunk.Replay());
+                }
+                PIMPL_(chunks).push_back(std::move(chunk));
+                if (isPiped)
+                {
+                    PIMPL_(pipe) = pipe;
+                }
                 PIMPL_LOCK_END;
                 PIMPL_(cv).notify_all();
-            }
-
-            COM_THREAD_END(PIMPL_(result));
 
-            // signal end
-            PIMPL_LOCK_BEGIN(m);
-            PIMPL_(isFilterDone) = true;
-            PIMPL_LOCK_END;
-            PIMPL_(cv).notify_all();
-        });
-
-        PIMPL_(wasFilterStarted) = true; // set the start flag
-        PIMPL_LOCK_END;
+                // pass on the text while it gets read
+                if (isPiped)
+                {
+                    pipe->Fill(filter);
+                    PIMPL_LOCK_BEGIN(m);
+                    PIMPL_(pipe) = std::nullopt;
+                    PIMPL_LOCK_END;
+                }
+            }
 
-        // return the write stream
-        return streams::WriteStream::CreateComInstance<sevenzip::ISequentialOutStream>(*PIMPL_(buffer));
+            COM_THREAD_END(filterResult);
+        }
+        PIMPL_(SetFilterDone)(filterResult);
     }
 
     void ItemTask::SetEndOfExtraction()
@@ -183,4 +379,31 @@ namespace com
             PIMPL_(buffer)->SetEndOfFile();
         }
     }
+
+    std::optional<CLSID> ItemTask::FindClsid(const FileDescription& description, const Registrar& registrar, ULONG recursionDepth, bool& sniff)
+    {
+        // preliminary checks on the file type
+        sniff = false;
+        if (description.IsDirectory) { return std::nullopt; } // only handle files
+        if (!description.SizeIsValid || description.Size > settings::maximum_file_size()) { return std::nullopt; } // file size unknown or too large
+        const auto clsid = registrar.FindClsid(description.Extension);
+        if (!clsid)
+        {
+            sniff = settings::sniff_unknown_items(); // no filter for the extension, but maybe for the content
+            return std::nullopt;
+        }
+        return LimitRecursion(clsid, recursionDepth);
+    }
+
+    std::optional<CLSID> ItemTask::SniffClsid(const void* header, ULONG length, const Registrar& registrar, ULONG recursionDepth)
+    {
+        // signatures first, plain text has none
+        const auto& sniffer = Sniffer::GetInstance();
+        auto extension = sniffer.FindExtension(header, length);
+        if (extension.empty() && sniffer.IsText(header, length)) { extension = STR(".txt"); }
+        if (extension.empty()) { return std::nullopt; }
+        const auto clsid = LimitRecursion(registrar.FindClsid(extension), recursionDepth);
+        if (clsid) { counters::increment(counters::counter::items_sniffed); }
+        return clsid;
+    }
 }
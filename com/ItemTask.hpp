@@ -25,8 +25,11 @@
 #include "CachedChunk.hpp"
 #include "FileDescription.hpp"
 #include "Filter.hpp"
+#include "MappedFile.hpp"
 #include "Registrar.hpp"
+#include "TextArena.hpp"
 
+#include <chrono>
 #include <optional>
 
 namespace com
@@ -37,11 +40,26 @@ namespace com
 
     CLASS_DECLARATION(ItemTask,
 public:
+    using Deadline = std::optional<std::chrono::steady_clock::time_point>;
+
     ItemTask(const FileDescription& description);
 
-    void Abort();
+    void Abort(); // abandons the sub-filter instead of waiting for it once the deadline has passed
+    void CacheText(); // keeps all text in the arena so that chunks can hand out views, must be called before Run
+    void IgnoreFilterErrors(); // for filters picked by the item's first bytes, whose failures only leave the name chunk, must be called before Run
     std::optional<CachedChunk> NextChunk(ULONG id);
-    sevenzip::ISequentialOutStreamPtr Run(const FilterAttributes& attributes, const Registrar& registrar, ULONG recursionDepth);
+    void Record(); // keeps a copy of every chunk for replicas and disables piping, must be called before Run
+    ItemTask Replicate(const FileDescription& description) const; // task for an identical item that replays this task's chunks under its own name, must not be run
+    sevenzip::ISequentialOutStreamPtr Run(const FilterAttributes& attributes, const CLSID& clsid, ULONG recursionDepth, const Deadline& archiveDeadline, const streams::MappedFile* source = nullptr, ULONGLONG sourceOffset = 0); // with a source, the sub-filter reads the item from there and nothing is returned
     void SetEndOfExtraction(); // will not call COM
+
+    static std::optional<CLSID> FindClsid(const FileDescription& description, const Registrar& registrar, ULONG recursionDepth, bool& sniff); // the filter for the item's extension, otherwise sniff tells whether its first bytes may still find one
+    static std::optional<CLSID> SniffClsid(const void* header, ULONG length, const Registrar& registrar, ULONG recursionDepth); // the filter for an item's first bytes, if any
+
+private:
+    explicit ItemTask(std::shared_ptr<impl>&& sharedImpl) noexcept; // for the gathering job, which only holds a weak reference until it runs
+
+    void Gather(const FilterAttributes& attributes, const CLSID& filterClsid, ULONG recursionDepth, bool streamText); // runs on the executor once the whole item is readable
+    std::optional<CachedChunk> ReplayChunk(size_t index) const; // waits for the chunk to be recorded, std::nullopt once there are no more
     );
 }
@@ -18,6 +18,7 @@
 
 #include "Registrar.hpp"
 
+#include "extension_table.hpp"
 #include "registry.hpp"
 #include "settings.hpp"
 
@@ -25,15 +26,31 @@
 #include "Filter.hpp"
 
 #include <functional>
+#include <map>
+#include <memory>
 #include <mutex>
-#include <unordered_map>
+#include <vector>
 
 namespace com
 {
+    constexpr static const auto MaximumMisses = size_t(256); // per Init, more get looked up again
+    constexpr static const auto MaximumCachedExtensions = size_t(4096); // the cache starts over beyond this
+
     CLASS_IMPLEMENTATION(Registrar,
 public:
-    std::mutex cacheMutex;
-    std::unordered_map<std::wstring, std::optional<CLSID>> cache;
+    using CacheTable = utils::extension_table<std::optional<CLSID>>;
+
+    CacheTable cache; // never changes once the registrar is shared, so it's read without locking
+    std::mutex missesMutex;
+    std::map<std::wstring, std::optional<CLSID>, utils::extension_less> misses; // results not yet in the cache, folded in by Compact
+
+    // remembers the result until the next Compact, unless there are already too many
+    std::optional<CLSID> Cache(std::wstring_view extension, const std::optional<CLSID>& result)
+    {
+        const auto lock = std::lock_guard<std::mutex>(missesMutex);
+        if (misses.size() < MaximumMisses) { misses.emplace(extension, result); }
+        return result;
+    }
     );
 
     constexpr static const auto PersistentHandlerGuid = GUID{ 0x8cc8186e, 0x4618, 0x426d, { 0xb7, 0x45, 0x44, 0x42, 0xf7, 0xe7, 0xa5, 0x6a } };
@@ -121,18 +138,19 @@ namespace com
 
     Registrar::Registrar() : PIMPL_INIT() {}
 
-    static bool IsKnownExtension(const std::wstring& extension)
+    static bool IsKnownExtension(std::wstring_view extension)
     {
-        const auto& formats = archive::Factory::GetInstance().Formats;
-        return formats.find(extension) != formats.end();
+        return archive::Factory::GetInstance().Formats.find(extension) != nullptr;
     }
 
-    std::optional<CLSID> Registrar::FindClsid(const std::wstring& extension) const
+    std::optional<CLSID> Registrar::FindClsid(std::wstring_view extension) const
     {
-        // check the cache first
-        PIMPL_LOCK_BEGIN(cacheMutex);
+        // check the cache first (without locking or allocating), then the results since the last Compact
         const auto cachedResult = PIMPL_(cache).find(extension);
-        if (cachedResult != PIMPL_(cache).end()) { return cachedResult->second; }
+        if (cachedResult != nullptr) { return *cachedResult; }
+        PIMPL_LOCK_BEGIN(missesMutex);
+        const auto miss = PIMPL_(misses).find(extension);
+        if (miss != PIMPL_(misses).end()) { return miss->second; }
         PIMPL_LOCK_END;
 
         // always use recursion if the extension is known and the behavior is wanted
@@ -140,15 +158,12 @@ namespace com
         {
             if (IsKnownExtension(extension))
             {
-                PIMPL_LOCK_BEGIN(cacheMutex);
-                PIMPL_(cache)[extension] = __uuidof(Filter);
-                PIMPL_LOCK_END;
-                return __uuidof(Filter);
+                return PIMPL_(Cache)(extension, __uuidof(Filter));
             }
         }
 
         // get the GUID of the persistent handler for the extension (ignore the null handler unless requested)
-        const auto persistentHandlerGuid = GetPersistentHandlerGuid(extension);
+        const auto persistentHandlerGuid = GetPersistentHandlerGuid(std::wstring(extension));
         if (persistentHandlerGuid && (*persistentHandlerGuid != NullPersistentHandlerGuid || !settings::ignore_null_persistent_handler()))
         {
             // open HKEY_LOCAL_MACHINE\SOFTWARE\Classes\CLSID\<PersistentHandlerGUID>\PersistentAddinsRegistered\{89BCB740-6119-101A-BCB7-00DD010655AF}
@@ -163,11 +178,7 @@ namespace com
             if (key)
             {
                 // parse, store and return the CLSID
-                const auto result = GetDefaultAsGuid(*key);
-                PIMPL_LOCK_BEGIN(cacheMutex);
-                PIMPL_(cache)[extension] = result;
-                PIMPL_LOCK_END;
-                return result;
+                return PIMPL_(Cache)(extension, GetDefaultAsGuid(*key));
             }
         }
 
@@ -176,18 +187,26 @@ namespace com
         {
             if (IsKnownExtension(extension))
             {
-                PIMPL_LOCK_BEGIN(cacheMutex);
-                PIMPL_(cache)[extension] = __uuidof(Filter);
-                PIMPL_LOCK_END;
-                return __uuidof(Filter);
+                return PIMPL_(Cache)(extension, __uuidof(Filter));
             }
         }
 
         // cache the negative result
-        PIMPL_LOCK_BEGIN(cacheMutex);
-        PIMPL_(cache)[extension] = std::nullopt;
-        PIMPL_LOCK_END;
-        return std::nullopt;
+        return PIMPL_(Cache)(extension, std::nullopt);
+    }
+
+    Registrar Registrar::Compact() const
+    {
+        const auto lock = std::lock_guard<std::mutex>(PIMPL_(missesMutex));
+        if (PIMPL_(misses).empty()) { return *this; }
+
+        // build a new cache with all results, unless it grew too large (e.g. from archives with lots of random extensions)
+        auto entries = std::vector<CacheTable::entry>();
+        if (PIMPL_(cache).size() + PIMPL_(misses).size() <= MaximumCachedExtensions) { entries.assign(PIMPL_(cache).begin(), PIMPL_(cache).end()); }
+        for (const auto& miss : PIMPL_(misses)) { entries.emplace_back(miss.first, miss.second); }
+        auto result = Registrar();
+        result.PIMPL_(cache) = CacheTable(std::move(entries));
+        return result;
     }
 
     HRESULT Registrar::RegisterServer() noexcept
@@ -22,7 +22,7 @@
 #include "pimpl.hpp"
 
 #include <optional>
-#include <string>
+#include <string_view>
 
 namespace com
 {
@@ -34,7 +34,8 @@ namespace com
 public:
     Registrar();
 
-    std::optional<CLSID> FindClsid(const std::wstring& extension) const; // extension must be lower-case and dot-prefixed
+    Registrar Compact() const; // returns a registrar whose lock-free cache also holds all results found so far, this one stays unchanged for anyone still using it
+    std::optional<CLSID> FindClsid(std::wstring_view extension) const; // extension must be dot-prefixed, the lookup is case-insensitive
 
     static HRESULT RegisterServer() noexcept;
     static HRESULT UnregisterServer() noexcept;
@@ -0,0 +1,145 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Sniffer.hpp"
+
+#include "extension_table.hpp"
+#include "signature_trie.hpp"
+
+#include "Factory.hpp"
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace com
+{
+    CLASS_IMPLEMENTATION(Sniffer,
+public:
+    using SignatureTrie = utils::signature_trie<std::wstring>;
+
+    ULONG HeaderSize = 0;
+    std::vector<std::pair<ULONG, SignatureTrie>> tries; // one per signature offset, ascending
+    );
+
+    constexpr static const auto MaximumHeaderSize = ULONG(0x10000); // formats with signatures further in are only recognized by extension
+    constexpr static const auto MinimumSignatureLength = size_t(3); // shorter ones (e.g. ext's two bytes at 0x438) match too many other files
+
+    // types that have iFilters of their own, checked before any archive format
+    static const std::pair<std::string_view, std::wstring_view> DocumentSignatures[] =
+    {
+        { std::string_view("%PDF-"), STR(".pdf") },
+        { std::string_view("{\\rtf"), STR(".rtf") },
+        { std::string_view("<?xml"), STR(".xml") },
+        { std::string_view("\xEF\xBB\xBF<?xml"), STR(".xml") },
+        { std::string_view("<!DOCTYPE html"), STR(".html") },
+        { std::string_view("<html"), STR(".html") },
+        { std::string_view("\x89PNG\r\n\x1A\n"), STR(".png") },
+        { std::string_view("\xFF\xD8\xFF"), STR(".jpg") },
+        { std::string_view("GIF87a"), STR(".gif") },
+        { std::string_view("GIF89a"), STR(".gif") },
+    };
+
+    static std::wstring GetFormatExtension(const archive::Format& format)
+    {
+        // prefer the one named after the format (e.g. .zip over .docx), otherwise take the lowest for a stable result
+        const auto named = CHR('.') + utils::fold_extension(format.Name);
+        if (format.Extensions.count(named) > 0) { return named; }
+        return *std::min_element(format.Extensions.begin(), format.Extensions.end());
+    }
+
+    Sniffer::Sniffer() : PIMPL_INIT()
+    {
+        // collect all signatures by their offset
+        auto entries = std::map<ULONG, std::vector<SignatureTrie::entry>>();
+        for (const auto& [signature, extension] : DocumentSignatures)
+        {
+            entries[0].emplace_back(std::string(signature), std::wstring(extension));
+        }
+        for (const auto& [ignored, format] : archive::Factory::GetInstance().Formats) // a format is listed once per extension, the trie keeps the first
+        {
+            if (format.Extensions.empty()) { continue; }
+            const auto extension = GetFormatExtension(format);
+            for (const auto& signature : format.Signatures)
+            {
+                if (signature.length() < MinimumSignatureLength || format.SignatureOffset > MaximumHeaderSize - std::min(static_cast<size_t>(MaximumHeaderSize), signature.length())) { continue; }
+                entries[format.SignatureOffset].emplace_back(signature, extension);
+            }
+        }
+
+        // build a trie for each offset
+        for (const auto& [offset, offsetEntries] : entries)
+        {
+            auto trie = SignatureTrie(offsetEntries);
+            PIMPL_(HeaderSize) = std::max(PIMPL_(HeaderSize), offset + static_cast<ULONG>(trie.max_length()));
+            PIMPL_(tries).emplace_back(offset, std::move(trie));
+        }
+    }
+
+    PIMPL_GETTER(Sniffer, ULONG, HeaderSize);
+
+    std::wstring_view Sniffer::FindExtension(const void* header, ULONG length) const noexcept
+    {
+        // the first offset with a matching signature decides
+        for (const auto& [offset, trie] : PIMPL_(tries))
+        {
+            if (offset >= length) { break; }
+            const auto extension = trie.find(static_cast<const BYTE*>(header) + offset, length - offset);
+            if (extension != nullptr) { return *extension; }
+        }
+        return std::wstring_view();
+    }
+
+    bool Sniffer::IsText(const void* header, ULONG length) const noexcept
+    {
+        // a BOM is enough, UTF-16 text is full of NULs otherwise
+        const auto bytes = static_cast<const BYTE*>(header);
+        if (length >= 3 && bytes[0] == 0xEF && bytes[1] == 0xBB && bytes[2] == 0xBF) { return true; }
+        if (length >= 2 && (bytes[0] == 0xFF && bytes[1] == 0xFE || bytes[0] == 0xFE && bytes[1] == 0xFF)) { return true; }
+
+        // otherwise it has to be valid UTF-8 (or ASCII) without control characters except whitespace
+        if (length == 0) { return false; }
+        for (auto i = ULONG(0); i < length; i++)
+        {
+            const auto byte = bytes[i];
+            if (byte < 0x20)
+            {
+                if (byte != '\t' && byte != '\n' && byte != '\r' && byte != '\f') { return false; }
+            }
+            else if (byte == 0x7F || byte >= 0x80)
+            {
+                // count the continuation bytes of the sequence, a sequence cut off by the end of the header is fine
+                const auto continuations = byte >= 0xC2 && byte <= 0xDF ? 1 : byte >= 0xE0 && byte <= 0xEF ? 2 : byte >= 0xF0 && byte <= 0xF4 ? 3 : -1;
+                if (continuations < 0) { return false; }
+                for (auto j = 0; j < continuations && ++i < length; j++)
+                {
+                    if ((bytes[i] & 0xC0) != 0x80) { return false; }
+                }
+            }
+        }
+        return true;
+    }
+
+    const Sniffer& Sniffer::GetInstance()
+    {
+        static const auto instance = Sniffer();
+        return instance;
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pimpl.hpp"
+#include "win32.hpp"
+
+#include <string_view>
+
+namespace com
+{
+    class Sniffer; // guesses the type of a file from its first bytes, using the signatures of all 7-Zip formats and some common document types
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION(Sniffer,
+private:
+    Sniffer();
+
+public:
+    PROPERTY_READONLY(ULONG, HeaderSize, PIMPL_GETTER_ATTRIB); // bytes needed to check every signature
+
+    std::wstring_view FindExtension(const void* header, ULONG length) const noexcept; // dot-prefixed extension of the type, empty if unknown
+    bool IsText(const void* header, ULONG length) const noexcept; // whether the header looks like plain text, which has no signature
+
+    static const Sniffer& GetInstance(); // built on first use, after the factory
+    );
+}
@@ -0,0 +1,82 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TextArena.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <memory>
+#include <vector>
+
+namespace com
+{
+    constexpr static const auto SlabSize = size_t(65536); // in characters
+
+    CLASS_IMPLEMENTATION_UNIQUE(TextArena,
+public:
+    std::vector<std::unique_ptr<WCHAR[]>> slabs;
+    WCHAR* span = nullptr; // start of the open span
+    size_t available = 0; // characters left in the current slab, starting at span
+    );
+
+    TextArena::TextArena() : PIMPL_INIT() {}
+
+    WCHAR* TextArena::Grow(size_t length, size_t additional)
+    {
+        assert(length <= PIMPL_(available));
+        if (PIMPL_(available) - length >= additional) { return PIMPL_(span); } // fast path, everything fits
+
+        // allocate a new slab that is large enough and at least twice the span to keep the copies amortized
+        const auto slabSize = std::max(SlabSize, (length + additional) * 2);
+        auto slab = std::make_unique<WCHAR[]>(slabSize);
+        if (length > 0)
+        {
+            std::wmemcpy(slab.get(), PIMPL_(span), length); // the only copy of existing text
+        }
+        if (!PIMPL_(slabs).empty() && PIMPL_(span) == PIMPL_(slabs).back().get())
+        {
+            PIMPL_(slabs).back() = std::move(slab); // the old slab only contained the open span
+        }
+        else
+        {
+            PIMPL_(slabs).push_back(std::move(slab));
+        }
+        PIMPL_(span) = PIMPL_(slabs).back().get();
+        PIMPL_(available) = slabSize;
+        return PIMPL_(span);
+    }
+
+    std::wstring_view TextArena::Seal(size_t length)
+    {
+        assert(length <= PIMPL_(available));
+        const auto result = std::wstring_view(PIMPL_(span), length);
+        PIMPL_(span) += length;
+        PIMPL_(available) -= length;
+        return result;
+    }
+
+    std::wstring_view TextArena::Copy(std::wstring_view text)
+    {
+        const auto span = Grow(0, text.length() + 1);
+        std::wmemcpy(span, text.data(), text.length());
+        span[text.length()] = CHR('\0');
+        const auto result = Seal(text.length());
+        Seal(1); // skip the null terminator
+        return result;
+    }
+}
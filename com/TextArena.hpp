@@ -0,0 +1,40 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pimpl.hpp"
+#include "win32.hpp"
+
+#include <string_view>
+
+namespace com
+{
+    class TextArena; // bump allocator for chunk text, only released as a whole, move-only
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION_UNIQUE(TextArena,
+public:
+    TextArena();
+
+    WCHAR* Grow(size_t length, size_t additional); // ensures room for additional characters after the open span of the given length, returns the span's (possibly moved) start
+    std::wstring_view Seal(size_t length); // closes the open span, the returned view stays valid as long as the arena lives
+    std::wstring_view Copy(std::wstring_view text); // the copy is always null-terminated
+    );
+}
@@ -0,0 +1,153 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TextPipe.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace com
+{
+    constexpr static const auto BlockSize = ULONG(8000); // in characters, including the null terminator
+    constexpr static const auto MaximumFilledBlocks = size_t(8);
+
+    CLASS_IMPLEMENTATION(TextPipe,
+                         PIMPL_CONSTRUCTOR(const Deadline& deadline) : deadline(deadline) {}
+public:
+    const Deadline deadline;
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::pair<std::vector<WCHAR>, ULONG>> filled;
+    std::vector<std::vector<WCHAR>> spare;
+    ULONG readOffset = 0;
+    bool closed = false;
+    bool cancelled = false;
+    );
+
+    TextPipe::TextPipe(const Deadline& deadline) : PIMPL_INIT(deadline) {}
+
+    void TextPipe::Cancel()
+    {
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(cancelled) = true;
+        PIMPL_LOCK_END;
+        PIMPL_(cv).notify_all();
+    }
+
+    void TextPipe::Fill(IFilter* filter)
+    {
+        if (filter == nullptr) { throw std::invalid_argument("filter"); }
+
+        try
+        {
+            auto isClosed = false;
+            while (!isClosed)
+            {
+                // wait until the reader has caught up and reuse a block if possible
+                auto block = std::vector<WCHAR>();
+                PIMPL_LOCK_BEGIN(m);
+                PIMPL_WAIT(m, cv, PIMPL_(filled).size() < MaximumFilledBlocks || PIMPL_(cancelled));
+                if (PIMPL_(cancelled)) { return; }
+                if (!PIMPL_(spare).empty())
+                {
+                    block = std::move(PIMPL_(spare).back());
+                    PIMPL_(spare).pop_back();
+                }
+                PIMPL_LOCK_END;
+                block.resize(BlockSize);
+
+                // let the sub-filter write into the block and pass it on (errors simply end the text)
+                auto length = BlockSize; // with null terminator on in, without null terminator on out
+                const auto textResult = filter->GetText(&length, block.data());
+                PIMPL_LOCK_BEGIN(m);
+                if (SUCCEEDED(textResult) && length > 0)
+                {
+                    PIMPL_(filled).emplace_back(std::move(block), std::min(length, BlockSize - 1));
+                }
+                isClosed = PIMPL_(closed) = FAILED(textResult) || textResult == FILTER_S_LAST_TEXT;
+                PIMPL_LOCK_END;
+                PIMPL_(cv).notify_all();
+            }
+        }
+        catch (...)
+        {
+            // never leave the reader waiting
+            PIMPL_LOCK_BEGIN(m);
+            PIMPL_(closed) = true;
+            PIMPL_LOCK_END;
+            PIMPL_(cv).notify_all();
+            throw;
+        }
+    }
+
+    SCODE TextPipe::Read(ULONG* pcwcBuffer, WCHAR* awcBuffer) noexcept
+    {
+        COM_CHECK_POINTER(pcwcBuffer);
+        COM_CHECK_POINTER(awcBuffer);
+        if (*pcwcBuffer == 0) { return E_NOT_SUFFICIENT_BUFFER; } // need at least space for the null terminator
+        COM_NOTHROW_BEGIN;
+
+        // wait for text, but not beyond the deadline (ItemTask::NextChunk will abandon the gatherer afterwards)
+        auto isLast = false;
+        PIMPL_LOCK_BEGIN(m);
+        if (!PIMPL_(deadline))
+        {
+            PIMPL_WAIT(m, cv, !PIMPL_(filled).empty() || PIMPL_(closed) || PIMPL_(cancelled));
+        }
+        else if (!PIMPL_WAIT_UNTIL(m, cv, *PIMPL_(deadline), !PIMPL_(filled).empty() || PIMPL_(closed) || PIMPL_(cancelled)))
+        {
+            PIMPL_(cancelled) = true;
+        }
+        if (PIMPL_(filled).empty() || PIMPL_(cancelled))
+        {
+            *pcwcBuffer = 0;
+            return FILTER_E_NO_MORE_TEXT;
+        }
+
+        // copy as much as fits and recycle all emptied blocks
+        const auto capacity = *pcwcBuffer - 1; // always null terminate strings but don't count it as copied character
+        auto copied = ULONG(0);
+        while (copied < capacity && !PIMPL_(filled).empty())
+        {
+            auto& front = PIMPL_(filled).front();
+            const auto count = std::min(capacity - copied, front.second - PIMPL_(readOffset));
+            std::wmemcpy(awcBuffer + copied, front.first.data() + PIMPL_(readOffset), count);
+            copied += count;
+            PIMPL_(readOffset) += count;
+            if (PIMPL_(readOffset) == front.second)
+            {
+                PIMPL_(spare).push_back(std::move(front.first));
+                PIMPL_(filled).pop_front();
+                PIMPL_(readOffset) = 0;
+            }
+        }
+        awcBuffer[copied] = CHR('\0');
+        *pcwcBuffer = copied;
+        isLast = PIMPL_(filled).empty() && PIMPL_(closed);
+        PIMPL_LOCK_END;
+        PIMPL_(cv).notify_all(); // let Fill know that there is space again
+        return isLast ? FILTER_S_LAST_TEXT : S_OK;
+
+        COM_NOTHROW_END;
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "com.hpp"
+#include "pimpl.hpp"
+
+#include <chrono>
+#include <optional>
+
+namespace com
+{
+    class TextPipe; // bounded hand-over of a chunk's text from the gatherer to the Windows thread
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION(TextPipe,
+public:
+    using Deadline = std::optional<std::chrono::steady_clock::time_point>;
+
+    explicit TextPipe(const Deadline& deadline);
+
+    void Cancel(); // no more text will be read, unblocks Fill
+    void Fill(IFilter* filter); // returns once all text has been passed on or the pipe got cancelled
+    SCODE Read(ULONG* pcwcBuffer, WCHAR* awcBuffer) noexcept; // same semantics as IFilter::GetText
+    );
+}
@@ -0,0 +1,78 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ArchiveReader.hpp"
+
+#include "Filter.hpp"
+
+#include <stdexcept>
+
+namespace embed
+{
+    CLASS_IMPLEMENTATION_UNIQUE(ArchiveReader,
+public:
+    IFilterPtr filter; // owns the filter, which aborts everything on its final release (it's a regular COM object of the linking module)
+    com::Filter* native = nullptr; // the same filter, for the calls that bypass IFilter
+
+    void Create()
+    {
+        filter = com::Filter::CreateComInstance<IFilter>();
+        native = static_cast<com::Filter*>(filter.GetInterfacePtr());
+        native->CacheChunkText(); // views need the text in the arena, not in a pipe
+    }
+
+    void Init(ULONG flags)
+    {
+        auto filterFlags = ULONG(0);
+        COM_DO_OR_THROW(filter->Init(flags, 0, nullptr, &filterFlags));
+    }
+    );
+
+    //----------------------------------------------------------------------------//
+
+    ArchiveReader::ArchiveReader(const std::filesystem::path& path, ULONG flags) : PIMPL_INIT()
+    {
+        PIMPL_(Create)();
+        COM_DO_OR_THROW(PIMPL_(native)->Load(path.c_str(), STGM_READ));
+        PIMPL_(Init)(flags);
+    }
+
+    ArchiveReader::ArchiveReader(IStream* stream, ULONG flags) : PIMPL_INIT()
+    {
+        if (stream == nullptr) { throw std::invalid_argument("stream"); }
+
+        PIMPL_(Create)();
+        COM_DO_OR_THROW(PIMPL_(native)->Initialize(stream, STGM_READ));
+        PIMPL_(Init)(flags);
+    }
+
+    //----------------------------------------------------------------------------//
+
+    std::optional<Chunk> ArchiveReader::Next()
+    {
+        auto text = std::wstring_view();
+        const auto chunk = PIMPL_(native)->NextChunk(text);
+        if (chunk == nullptr) { return std::nullopt; }
+        return Chunk{ chunk->Stat, chunk->Code, chunk->IsName, text, chunk->PendingValue };
+    }
+
+    void ArchiveReader::ForEach(const std::function<bool(const Chunk&)>& callback)
+    {
+        for (auto chunk = Next(); chunk && callback(*chunk); chunk = Next()) {}
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "com.hpp"
+#include "pimpl.hpp"
+
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <string_view>
+
+namespace embed
+{
+    struct Chunk; // a chunk handed out by ArchiveReader, its views stay valid until the next chunk is requested
+    class ArchiveReader; // filters an archive in-process like the iFilter does, but hands out views into its buffers instead of copying them through IFilter, not thread-safe (sub-filters, even for nested archives, still copy through their own GetText)
+
+    /******************************************************************************/
+
+    struct Chunk
+    {
+        STAT_CHUNK Stat; // the attribute's name (if any) is a view as well
+        SCODE Code; // e.g. FILTER_E_PASSWORD for an item that couldn't be filtered, in which case there is neither text nor value
+        bool IsItemName; // the text is the name of an item, whose chunks follow
+        std::wstring_view Text; // view into the item's arena, truncated at the text budget
+        const PROPVARIANT* Value; // nullptr for text chunks
+    };
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION_UNIQUE(ArchiveReader,
+public:
+    static constexpr ULONG DefaultFlags = IFILTER_INIT_CANON_PARAGRAPHS | IFILTER_INIT_APPLY_INDEX_ATTRIBUTES;
+
+    explicit ArchiveReader(const std::filesystem::path& path, ULONG flags = DefaultFlags); // reads the archive through a file mapping if possible
+    explicit ArchiveReader(IStream* stream, ULONG flags = DefaultFlags); // the stream's name selects the format, its first bytes if that fails
+
+    std::optional<Chunk> Next(); // waits for the next chunk, std::nullopt after the last one
+    void ForEach(const std::function<bool(const Chunk&)>& callback); // stops early once the callback returns false
+    );
+}
@@ -17,17 +17,26 @@
  */
 
 #include "com.hpp"
+#include "counters.hpp"
+#include "threads.hpp"
 
 #include "ClassFactory.hpp"
 #include "Registrar.hpp"
 
 BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved) noexcept
 {
-    UNREFERENCED_PARAMETER(lpvReserved);
     if (fdwReason == DLL_PROCESS_ATTACH)
     {
         ::DisableThreadLibraryCalls(hinstDLL);
     }
+    else if (fdwReason == DLL_PROCESS_DETACH)
+    {
+        counters::trace();
+        if (lpvReserved == nullptr)
+        {
+            threads::shutdown(); // FreeLibrary, DllCanUnloadNow made sure no job is left (on process exit the pool goes with it)
+        }
+    }
     return TRUE;
 }
 
@@ -38,7 +47,7 @@ STDAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, LPVOID* ppv)
 
 STDAPI DllCanUnloadNow()
 {
-    return com::object::count() > 0 ? S_FALSE : S_OK;
+    return com::object::count() > 0 || threads::outstanding() > 0 ? S_FALSE : S_OK; // abandoned sub-filters still run our code
 }
 
 STDAPI DllRegisterServer()
@@ -20,7 +20,9 @@
 
 #include "registry.hpp"
 
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <future>
 #include <ios>
 #include <new>
@@ -30,11 +32,6 @@ namespace com
 {
     static std::atomic<size_t> _object_count = 0;
 
-    static void* offset_ptr(void* ptr, ptrdiff_t offset) noexcept
-    {
-        return reinterpret_cast<void*>(reinterpret_cast<intptr_t>(ptr) + offset);
-    }
-
     class unknown : public IUnknown
     {
         const std::unique_ptr<object> _object_ptr;
@@ -69,9 +66,9 @@ namespace com
             }
             else
             {
-                const auto entry = _interface_map.find(riid); // not a noexcept, but operator== should never throw
-                if (entry == _interface_map.end()) { return E_NOINTERFACE; }
-                *ppvObject = offset_ptr(_object_ptr.get(), entry->second);
+                const auto entry = _interface_map.find(riid);
+                if (entry == nullptr) { return E_NOINTERFACE; }
+                *ppvObject = entry->cast(_object_ptr.get());
             }
             reinterpret_cast<IUnknown*>(*ppvObject)->AddRef(); // important, might get forwarded to outer unknown
             return S_OK;
@@ -95,6 +92,16 @@ namespace com
 
     //----------------------------------------------------------------------------//
 
+    const interface_entry* object_interface_map::find(REFIID id) const noexcept
+    {
+        // binary search over the entries sorted by make_interface_entries
+        const auto end = _entries + _count;
+        const auto entry = std::lower_bound(_entries, end, id, [](const interface_entry& entry, REFIID id) { return iid_less(entry.id, id); });
+        return entry != end && entry->id == id ? entry : nullptr;
+    }
+
+    //----------------------------------------------------------------------------//
+
     IUnknown* object::unknown() noexcept
     {
         assert(_unknown);
@@ -157,9 +164,9 @@ namespace com
         {
             // non-aggregated, query the interface if it exists
             const auto entry = interface_map.find(interface_id);
-            if (entry == interface_map.end()) { COM_THROW(E_NOINTERFACE); }
+            if (entry == nullptr) { COM_THROW(E_NOINTERFACE); }
             inner_object->_unknown = static_cast<IUnknown*>(new com::unknown(std::move(object_ptr), interface_map)); // IUnknown is handled internally
-            *com_object = offset_ptr(inner_object, entry->second); // return the pointer to the requested interface
+            *com_object = entry->cast(inner_object); // return the pointer to the requested interface
         }
     }
 }
@@ -20,11 +20,11 @@
 
 #include "win32.hpp"
 
+#include <array>
 #include <cassert>
 #include <memory>
 #include <system_error>
 #include <type_traits>
-#include <unordered_map>
 
 #include <comip.h>
 #include <comdef.h>
@@ -43,7 +43,38 @@ _COM_SMARTPTR_TYPEDEF(IInitializeWithStream, IID_IInitializeWithStream);
 
 namespace com
 {
-    using object_interface_map = std::unordered_map<IID, ptrdiff_t>;
+    class object;
+
+    struct interface_entry
+    {
+        IID id;
+        void* (*cast)(object* object) noexcept; // adjusts the object pointer to the interface
+    };
+
+    constexpr bool iid_less(const IID& left, const IID& right) noexcept
+    {
+        if (left.Data1 != right.Data1) { return left.Data1 < right.Data1; }
+        if (left.Data2 != right.Data2) { return left.Data2 < right.Data2; }
+        if (left.Data3 != right.Data3) { return left.Data3 < right.Data3; }
+        for (auto i = size_t(0); i < sizeof(left.Data4); i++)
+        {
+            if (left.Data4[i] != right.Data4[i]) { return left.Data4[i] < right.Data4[i]; }
+        }
+        return false;
+    }
+
+    class object_interface_map // view over a class's constant interface entries, sorted by IID at compile time
+    {
+    private:
+        const interface_entry* _entries;
+        size_t _count;
+
+    public:
+        template <size_t Count>
+        constexpr object_interface_map(const std::array<interface_entry, Count>& entries) noexcept : _entries(entries.data()), _count(Count) {}
+
+        const interface_entry* find(REFIID id) const noexcept;
+    };
 
     class object : public IUnknown
     {
@@ -108,12 +139,17 @@ namespace errors
     { \
         static_assert(std::is_base_of_v<Interface, self>); \
         auto ptr = _com_ptr_t<_com_IIID<Interface, &__uuidof(Interface)>>(); \
-        com::object::create(std::make_unique<self>(std::forward<Args>(args)...), self::interface_map, nullptr, __uuidof(Interface), reinterpret_cast<void**>(&ptr)); \
+        com::object::create(std::make_unique<self>(std::forward<Args>(args)...), self::interface_map(), nullptr, __uuidof(Interface), reinterpret_cast<void**>(&ptr)); \
         return ptr; \
     }
 
 #define COM_VISIBLE(...) \
-    public: static inline const auto interface_map = utils::make_interface_map<self, __VA_ARGS__>();
+    public: static const com::object_interface_map& interface_map() noexcept /* a member function, since the class is only complete in there */ \
+    { \
+        static constexpr auto entries = utils::make_interface_entries<self, __VA_ARGS__>(); \
+        static constexpr auto map = com::object_interface_map(entries); \
+        return map; \
+    }
 
 #define COM_CLASS_DECLARATION(className, comInterfaces, ...) \
     CLASS_DECLARATION_EXTENDS(className, (public com::object, public com::interfaces<_CLASS_INLINE comInterfaces>), COM_VISIBLE comInterfaces COM_CLASS private: __VA_ARGS__)
@@ -202,22 +238,33 @@ namespace utils
     static HRESULT make_com(IUnknown* pUnkOuter, REFIID riid, void** ppvObject, Args&&... args) noexcept
     {
         COM_NOTHROW_BEGIN;
-        com::object::create(std::make_unique<Type>(std::forward<Args>(args)...), Type::interface_map, pUnkOuter, riid, ppvObject);
+        com::object::create(std::make_unique<Type>(std::forward<Args>(args)...), Type::interface_map(), pUnkOuter, riid, ppvObject);
         return S_OK;
         COM_NOTHROW_END;
     }
 
-    template <typename Type, typename... Interfaces>
-    com::object_interface_map make_interface_map()
+    template <typename Type, typename Interface>
+    void* cast_to_interface(com::object* object) noexcept
     {
-        return com::object_interface_map({ {__uuidof(Interfaces), offset_of_interface<Type, Interfaces>()}... });
+        static_assert(std::is_base_of_v<Interface, Type>);
+        return static_cast<Interface*>(static_cast<Type*>(object));
     }
 
-    template <typename Type, typename Interface>
-    constexpr ptrdiff_t offset_of_interface()
+    template <typename Type, typename... Interfaces>
+    constexpr std::array<com::interface_entry, sizeof...(Interfaces)> make_interface_entries() noexcept
     {
-        static_assert(std::is_base_of_v<Interface, Type>);
-        constexpr const auto not_null = intptr_t(0x00400000); // compiler will optimize null-pointer out
-        return reinterpret_cast<intptr_t>(static_cast<Interface*>(static_cast<Type*>(reinterpret_cast<com::object*>(not_null)))) - not_null;
+        auto entries = std::array<com::interface_entry, sizeof...(Interfaces)>{ { { __uuidof(Interfaces), &cast_to_interface<Type, Interfaces> }... } };
+
+        // insertion sort, there are only a handful of entries
+        for (auto i = size_t(1); i < entries.size(); i++)
+        {
+            for (auto j = i; j > 0 && com::iid_less(entries[j].id, entries[j - 1].id); j--)
+            {
+                const auto entry = entries[j];
+                entries[j] = entries[j - 1];
+                entries[j - 1] = entry;
+            }
+        }
+        return entries;
     }
 }
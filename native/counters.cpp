@@ -0,0 +1,90 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "counters.hpp"
+
+#include <array>
+#include <atomic>
+#include <string>
+
+namespace counters
+{
+    constexpr static const auto count = static_cast<size_t>(counter::count_);
+
+    constexpr static const std::array<win32::czwstring, count> names =
+    {
+        STR("ArchivesOverBudget"),
+        STR("BufferReadsWaited"),
+        STR("BufferWakeups"),
+        STR("DuplicateItemsReplayed"),
+        STR("FactoryModulesCached"),
+        STR("FactoryModulesQueried"),
+        STR("FactoryStartupMicroseconds"),
+        STR("FileViewHits"),
+        STR("FileViewMaps"),
+        STR("FileViewMapsPerItem"),
+        STR("ItemsSniffed"),
+        STR("ModuleLoads"),
+        STR("ModulesResident"),
+        STR("NameOnlyItems"),
+        STR("SpillFilesCreated"),
+        STR("SpillFilesReused"),
+        STR("SpillPoolBytes"),
+        STR("StoredItemsReadDirectly"),
+        STR("ThreadsReserved"),
+    };
+
+    static std::array<std::atomic<ULONGLONG>, count> values = {};
+
+    void decrement(counter counter, ULONGLONG amount) noexcept
+    {
+        values[static_cast<size_t>(counter)].fetch_sub(amount, std::memory_order_relaxed);
+    }
+
+    void increment(counter counter, ULONGLONG amount) noexcept
+    {
+        values[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    void maximize(counter counter, ULONGLONG value) noexcept
+    {
+        auto& current = values[static_cast<size_t>(counter)];
+        auto previous = current.load(std::memory_order_relaxed);
+        while (previous < value && !current.compare_exchange_weak(previous, value, std::memory_order_relaxed)) {}
+    }
+
+    ULONGLONG value(counter counter) noexcept
+    {
+        return values[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+    }
+
+    void trace() noexcept
+    {
+        try
+        {
+            auto text = std::wstring(L"iFilter4Archives counters:");
+            for (auto i = size_t(0); i < count; i++)
+            {
+                text.append(L" ").append(names[i].c_str()).append(L"=").append(std::to_wstring(values[i].load(std::memory_order_relaxed)));
+            }
+            text.append(L"\n");
+            ::OutputDebugStringW(text.c_str());
+        }
+        catch (...) {} // tracing is best effort
+    }
+}
@@ -0,0 +1,54 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "win32.hpp"
+
+namespace counters
+{
+    enum class counter
+    {
+        archives_over_budget, // top-level archives that got cut off by MaximumTextCharacters or MaximumChunks
+        buffer_reads_waited, // buffer reads that had to lock and wait for the writer, all others read without locking
+        buffer_wakeups, // times a buffer's writer woke up waiting readers, appends short of what they need don't
+        duplicate_items_replayed, // items whose chunks were copied from an identical item instead of being extracted and filtered again
+        factory_modules_cached, // 7-Zip modules whose formats were taken from the format cache
+        factory_modules_queried, // 7-Zip modules whose formats had to be queried
+        factory_startup_microseconds, // time spent building the format table
+        file_view_hits, // reads of disk-backed items served by an already mapped window
+        file_view_maps, // windows of disk-backed items that had to be mapped
+        file_view_maps_per_item, // most windows mapped for a single item
+        items_sniffed, // items whose filter was picked by their first bytes instead of their extension
+        module_loads, // times a 7-Zip module got loaded
+        modules_resident, // 7-Zip modules currently loaded
+        name_only_items, // items that were listed by name only, without a task
+        spill_files_created, // temporary files created for items above MaximumBufferSize
+        spill_files_reused, // temporary files taken from the spill pool instead
+        spill_pool_bytes, // size of all temporary files currently waiting in the spill pool
+        stored_items_read_directly, // uncompressed items that sub-filters read straight from a mapped archive
+        threads_reserved, // extra decoder threads currently taken from ThreadBudget
+        count_ // not a counter
+    };
+
+    void decrement(counter counter, ULONGLONG amount = 1) noexcept; // for counters that represent a current state
+    void increment(counter counter, ULONGLONG amount = 1) noexcept;
+    void maximize(counter counter, ULONGLONG value) noexcept; // for counters that represent a peak
+    ULONGLONG value(counter counter) noexcept;
+    void trace() noexcept; // writes all counters to the debugger output
+}
@@ -0,0 +1,149 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+    constexpr wchar_t fold_extension_char(wchar_t c) noexcept
+    {
+        return c >= L'A' && c <= L'Z' ? static_cast<wchar_t>(c - L'A' + L'a') : c; // same as _wcslwr_s in the C locale
+    }
+
+    inline std::wstring fold_extension(std::wstring_view extension)
+    {
+        auto result = std::wstring(extension);
+        for (auto& c : result) { c = fold_extension_char(c); }
+        return result;
+    }
+
+    constexpr std::wstring_view extension_of(std::wstring_view name) noexcept // same as std::filesystem::path::extension, but without allocations
+    {
+        const auto separator = name.find_last_of(L"\\/");
+        const auto file_name = separator == std::wstring_view::npos ? name : name.substr(separator + 1);
+        if (file_name == L"." || file_name == L"..") { return std::wstring_view(); }
+        const auto dot = file_name.rfind(L'.');
+        if (dot == std::wstring_view::npos || dot == 0) { return std::wstring_view(); }
+        return file_name.substr(dot);
+    }
+
+    struct extension_less // case-insensitive ordering for maps keyed by extension, allows lookups by view
+    {
+        using is_transparent = void;
+
+        bool operator()(std::wstring_view left, std::wstring_view right) const noexcept
+        {
+            const auto length = left.length() < right.length() ? left.length() : right.length();
+            for (auto i = std::size_t(0); i < length; i++)
+            {
+                const auto l = fold_extension_char(left[i]);
+                const auto r = fold_extension_char(right[i]);
+                if (l != r) { return l < r; }
+            }
+            return left.length() < right.length();
+        }
+    };
+
+    /******************************************************************************/
+
+    template <typename Value>
+    class extension_table // immutable open-addressing hash table, looked up case-insensitively without any allocations
+    {
+    public:
+        using entry = std::pair<std::wstring, Value>; // the key is stored folded
+
+    private:
+        std::vector<entry> _entries; // in insertion order
+        std::vector<std::uint32_t> _slots; // index into _entries plus one, zero means empty
+        std::size_t _mask = 0;
+
+        static std::size_t hash(std::wstring_view extension) noexcept
+        {
+            auto value = std::size_t(14695981039346656037ull); // FNV-1a, truncated on 32-bit
+            for (const auto c : extension)
+            {
+                value ^= fold_extension_char(c);
+                value *= std::size_t(1099511628211ull);
+            }
+            return value;
+        }
+
+        static bool equals(std::wstring_view folded, std::wstring_view extension) noexcept
+        {
+            if (folded.length() != extension.length()) { return false; }
+            for (auto i = std::size_t(0); i < folded.length(); i++)
+            {
+                if (folded[i] != fold_extension_char(extension[i])) { return false; }
+            }
+            return true;
+        }
+
+        std::optional<std::size_t> find_index(std::wstring_view extension) const noexcept
+        {
+            if (_slots.empty()) { return std::nullopt; }
+            for (auto slot = hash(extension) & _mask; _slots[slot] != 0; slot = (slot + 1) & _mask)
+            {
+                const auto index = _slots[slot] - 1;
+                if (equals(_entries[index].first, extension)) { return index; }
+            }
+            return std::nullopt;
+        }
+
+    public:
+        extension_table() = default;
+
+        explicit extension_table(std::vector<entry> entries) // later entries with an already existing extension are ignored
+        {
+            if (entries.size() >= 0x40000000) { throw std::length_error("entries"); }
+
+            // keep the load factor at or below one half
+            auto capacity = std::size_t(8);
+            while (capacity < entries.size() * 2) { capacity *= 2; }
+            _slots.resize(capacity);
+            _mask = capacity - 1;
+            _entries.reserve(entries.size());
+            for (auto& entry : entries)
+            {
+                if (find_index(entry.first)) { continue; }
+                auto slot = hash(entry.first) & _mask;
+                while (_slots[slot] != 0) { slot = (slot + 1) & _mask; }
+                entry.first = fold_extension(entry.first);
+                _entries.push_back(std::move(entry));
+                _slots[slot] = static_cast<std::uint32_t>(_entries.size());
+            }
+        }
+
+        const Value* find(std::wstring_view extension) const noexcept
+        {
+            const auto index = find_index(extension);
+            return index ? &_entries[*index].second : nullptr;
+        }
+
+        auto begin() const noexcept { return _entries.begin(); }
+        auto end() const noexcept { return _entries.end(); }
+        std::size_t size() const noexcept { return _entries.size(); }
+    };
+}
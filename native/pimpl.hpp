@@ -19,20 +19,83 @@
 #pragma once
 
 #include <cassert>
+#include <cstddef>
 #include <memory>
+#include <new>
 #include <type_traits>
+#include <utility>
 
+namespace utils
+{
+    template <typename Impl, std::size_t Size>
+    class inline_ptr // holds the impl within its owner like std::optional, for move-only classes created on hot paths, the size gets checked where the impl is complete
+    {
+    private:
+        alignas(std::max_align_t) unsigned char _storage[Size];
+        bool _engaged = false;
+
+    public:
+        inline_ptr() noexcept = default;
+        template <typename... Args> explicit inline_ptr(std::in_place_t, Args&&... args)
+        {
+            static_assert(sizeof(Impl) <= Size, "impl doesn't fit, increase the size");
+            static_assert(alignof(Impl) <= alignof(std::max_align_t));
+            new (_storage) Impl(std::forward<Args>(args)...);
+            _engaged = true;
+        }
+        inline_ptr(const inline_ptr&) = delete;
+        inline_ptr(inline_ptr&& other) noexcept { *this = std::move(other); }
+        ~inline_ptr() noexcept { reset(); }
+
+        inline_ptr& operator=(const inline_ptr&) = delete;
+        inline_ptr& operator=(inline_ptr&& other) noexcept
+        {
+            // like a moved unique_ptr, the other one is empty afterwards
+            if (this == &other) { return *this; }
+            reset();
+            if (!other._engaged) { return *this; }
+            new (_storage) Impl(std::move(*other.get()));
+            _engaged = true;
+            other.reset();
+            return *this;
+        }
+
+        Impl* get() const noexcept { return _engaged ? operator->() : nullptr; }
+        Impl* operator->() const noexcept { return std::launder(reinterpret_cast<Impl*>(const_cast<unsigned char*>(_storage))); }
+        explicit operator bool() const noexcept { return _engaged; }
+
+        void reset() noexcept
+        {
+            if (!_engaged) { return; }
+            operator->()->~Impl();
+            _engaged = false;
+        }
+    };
+}
+
+#define _PIMPL_POINTER(pointerType, factory) \
+    struct impl; pointerType<impl> pImpl; \
+    template <typename... Args> static pointerType<impl> make_impl(Args&&... args) \
+    { return factory<impl>(std::forward<Args>(args)...); }
+#define _PIMPL_INLINE(size) \
+    struct impl; utils::inline_ptr<impl, (size)> pImpl; \
+    template <typename... Args> static utils::inline_ptr<impl, (size)> make_impl(Args&&... args) \
+    { return utils::inline_ptr<impl, (size)>(std::in_place, std::forward<Args>(args)...); }
 #ifdef NDEBUG
-#define PIMPL struct impl; std::shared_ptr<impl> pImpl
+#define PIMPL _PIMPL_POINTER(std::shared_ptr, std::make_shared)
+#define PIMPL_UNIQUE _PIMPL_POINTER(std::unique_ptr, std::make_unique)
+#define PIMPL_INLINE(size) _PIMPL_INLINE(size)
 #define PIMPL_(member) pImpl->member
 #else
-#define PIMPL \
-    struct impl; std::shared_ptr<impl> pImpl; \
+#define _PIMPL_ASSERT \
     impl* assert_pimpl() const \
     { \
         assert(pImpl); \
         return pImpl.get(); \
     }
+#define PIMPL _PIMPL_POINTER(std::shared_ptr, std::make_shared); _PIMPL_ASSERT
+#define PIMPL_UNIQUE _PIMPL_POINTER(std::unique_ptr, std::make_unique); _PIMPL_ASSERT
+#define PIMPL_INLINE(size) _PIMPL_INLINE(size); _PIMPL_ASSERT
 #define PIMPL_(member) assert_pimpl()->member
 #endif
 #define PIMPL_IMPL(type, ...) \
@@ -45,6 +108,16 @@
         public: impl& operator= (impl&&) = delete; \
         __VA_ARGS__ \
     }
+#define PIMPL_IMPL_MOVABLE(type, ...) \
+    struct type::impl \
+    { \
+        public: impl() = default; \
+        public: impl(const impl&) = delete; \
+        public: impl(impl&& other) noexcept; \
+        public: impl& operator= (const impl&) = delete; \
+        public: impl& operator= (impl&&) = delete; \
+        __VA_ARGS__ \
+    }
 #define PIMPL_CONSTRUCTOR public: impl
 #define PIMPL_DECONSTRUCTOR() public: ~impl() noexcept
 #ifdef NDEBUG
@@ -52,7 +125,12 @@
 #else
 #define PIMPL_CAPTURE assert_pimpl = ([pImpl = pImpl.get()](){assert(pImpl); return pImpl;})
 #endif
-#define PIMPL_INIT(...) pImpl(std::make_shared<impl>(__VA_ARGS__))
+#ifdef NDEBUG
+#define PIMPL_CAPTURE_SHARED pImpl = pImpl
+#else
+#define PIMPL_CAPTURE_SHARED assert_pimpl = ([pImpl = pImpl](){assert(pImpl); return pImpl.get();})
+#endif
+#define PIMPL_INIT(...) pImpl(make_impl(__VA_ARGS__))
 #define PIMPL_GETTER_ATTRIB const noexcept
 #define PIMPL_GETTER(className, propertyType, propertyName) \
     propertyType className::Get##propertyName() PIMPL_GETTER_ATTRIB \
@@ -67,6 +145,7 @@
 #define PIMPL_LOCK_END \
     }
 #define PIMPL_WAIT(mutexMember, cvMember, condition) PIMPL_(cvMember).wait(_lock_##mutexMember, [&] { return (condition); })
+#define PIMPL_WAIT_UNTIL(mutexMember, cvMember, timePoint, condition) PIMPL_(cvMember).wait_until(_lock_##mutexMember, (timePoint), [&] { return (condition); })
 
  /******************************************************************************/
 
@@ -106,6 +185,44 @@
         __VA_ARGS__ \
     }
 
+#define CLASS_DECLARATION_UNIQUE(className, ...) \
+    class className \
+    { \
+        private: using self = className; \
+        public: virtual ~className() noexcept; \
+        public: className(const className&) = delete; \
+        public: className(className&&) noexcept; \
+        public: className& operator= (const className&) = delete; \
+        public: className& operator= (className&&) noexcept; \
+        private: PIMPL_UNIQUE; \
+        __VA_ARGS__ \
+    }
+
+#define CLASS_IMPLEMENTATION_UNIQUE(className, ...) \
+    className::~className() noexcept = default; \
+    className::className(className&&) noexcept = default; \
+    className& className::operator= (className&&) noexcept = default; \
+    PIMPL_IMPL(className, __VA_ARGS__)
+
+#define CLASS_DECLARATION_INLINE(className, implSize, ...) \
+    class className \
+    { \
+        private: using self = className; \
+        public: virtual ~className() noexcept; \
+        public: className(const className&) = delete; \
+        public: className(className&&) noexcept; \
+        public: className& operator= (const className&) = delete; \
+        public: className& operator= (className&&) noexcept; \
+        private: PIMPL_INLINE(implSize); \
+        __VA_ARGS__ \
+    }
+
+#define CLASS_IMPLEMENTATION_INLINE(className, ...) \
+    PIMPL_IMPL_MOVABLE(className, __VA_ARGS__); \
+    className::~className() noexcept = default; \
+    className::className(className&&) noexcept = default; \
+    className& className::operator= (className&&) noexcept = default
+
 #define CLASS_IMPLEMENTATION(className, ...) \
     className::~className() noexcept = default; \
     className::className(const className&) noexcept = default; \
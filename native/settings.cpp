@@ -30,11 +30,42 @@ namespace settings
         return key ? key->get_dword_value(name).value_or(default_value) : default_value;
     }
 
+    DWORD archive_time_limit()
+    {
+        return read_dword(STR("ArchiveTimeLimit"), 0); // in seconds, zero means unlimited
+    }
+
     DWORD concurrent_filter_threads()
     {
         return read_dword(STR("ConcurrentFilterThreads"), std::thread::hardware_concurrency());
     }
 
+    DWORD decoder_memory_limit()
+    {
+        return read_dword(STR("DecoderMemoryLimit"), 0); // in megabytes, zero keeps the default of each format
+    }
+
+    DWORD extension_weight(win32::czwstring extension)
+    {
+        const auto key = win32::registry_key::local_machine().open_sub_key_readonly(STR("SOFTWARE\\iFilter4Archives\\ExtensionWeights"));
+        return key ? key->get_dword_value(extension).value_or(100) : 100; // in percent of the item size
+    }
+
+    DWORD extraction_order()
+    {
+        return read_dword(STR("ExtractionOrder"), 0); // 0 = archive order, 1 = smallest (weighted) items first
+    }
+
+    DWORD file_view_count()
+    {
+        return read_dword(STR("FileViewCount"), 4);
+    }
+
+    SIZE_T file_view_size()
+    {
+        return read_dword(STR("FileViewSize"), 0); // in bytes, zero means MaximumBufferSize
+    }
+
     bool ignore_null_persistent_handler()
     {
         return read_dword(STR("IgnoreNullPersistentHandler"), 1);
@@ -45,6 +76,11 @@ namespace settings
         return read_dword(STR("IgnoreRegisteredPersistentHandlerIfArchive"), 0);
     }
 
+    DWORD item_time_limit()
+    {
+        return read_dword(STR("ItemTimeLimit"), 0); // in seconds, zero means unlimited
+    }
+
     ULONGLONG maximum_file_size()
     {
         return read_dword(STR("MaximumFileSize"), 16) * 1048576ull; // should be equal to MaxDownloadSize
@@ -55,11 +91,56 @@ namespace settings
         return read_dword(STR("MaximumBufferSize"), 4194304); // should harmonize with FilterProcessMemoryQuota
     }
 
+    DWORD maximum_chunks()
+    {
+        return read_dword(STR("MaximumChunks"), 0); // per top-level archive, zero means unlimited
+    }
+
+    DWORD maximum_text_characters()
+    {
+        return read_dword(STR("MaximumTextCharacters"), 0); // dito
+    }
+
+    DWORD module_idle_time()
+    {
+        return read_dword(STR("ModuleIdleTime"), 300); // in seconds, zero means never unload
+    }
+
+    bool read_stored_items_directly()
+    {
+        return read_dword(STR("ReadStoredItemsDirectly"), 1);
+    }
+
     DWORD recursion_depth_limit()
     {
         return read_dword(STR("RecursionDepthLimit"), 1);
     }
 
+    bool skip_duplicate_items()
+    {
+        return read_dword(STR("SkipDuplicateItems"), 1);
+    }
+
+    bool sniff_unknown_items()
+    {
+        return read_dword(STR("SniffUnknownItems"), 0);
+    }
+
+    ULONGLONG spill_pool_size()
+    {
+        return read_dword(STR("SpillPoolSize"), 64) * 1048576ull; // zero disables pooling
+    }
+
+    bool stream_chunk_text()
+    {
+        return read_dword(STR("StreamChunkText"), 1);
+    }
+
+    DWORD thread_budget()
+    {
+        return read_dword(STR("ThreadBudget"), std::thread::hardware_concurrency());
+    }
+
     bool use_internal_persistent_handler_if_none_registered()
     {
         return read_dword(STR("UseInternalPersistentHandlerIfNoneRegistered"), 1);
@@ -22,11 +22,27 @@
 
 namespace settings
 {
+    DWORD archive_time_limit();
     DWORD concurrent_filter_threads();
+    DWORD decoder_memory_limit();
+    DWORD extension_weight(win32::czwstring extension);
+    DWORD extraction_order();
+    DWORD file_view_count();
+    SIZE_T file_view_size();
     bool ignore_null_persistent_handler();
     bool ignore_registered_persistent_handler_if_archive();
+    DWORD item_time_limit();
     ULONGLONG maximum_file_size();
     SIZE_T maximum_buffer_size();
+    DWORD maximum_chunks();
+    DWORD maximum_text_characters();
+    DWORD module_idle_time();
+    bool read_stored_items_directly();
     DWORD recursion_depth_limit();
+    bool skip_duplicate_items();
+    bool sniff_unknown_items();
+    ULONGLONG spill_pool_size();
+    bool stream_chunk_text();
+    DWORD thread_budget();
     bool use_internal_persistent_handler_if_none_registered();
 }
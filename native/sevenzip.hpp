@@ -212,6 +212,11 @@ namespace sevenzip
     STDMETHOD(GetSize)(UINT64* size) PURE;
     );
 
+    SEVENZIP_INTERFACE(06, 03, ISetProperties, IUnknown,
+public:
+    STDMETHOD(SetProperties)(const wchar_t* const* names, const PROPVARIANT* values, UINT32 numProps) PURE;
+    );
+
     SEVENZIP_INTERFACE(06, 10, IArchiveOpenCallback, IUnknown,
 public:
     STDMETHOD(SetTotal)(const UINT64* files, const UINT64* bytes) PURE;
@@ -0,0 +1,128 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace utils
+{
+    template <typename Value>
+    class signature_trie // immutable byte trie that finds the longest signature a header starts with, looked up without any allocations
+    {
+    public:
+        using entry = std::pair<std::string, Value>; // the key is binary
+
+    private:
+        struct node
+        {
+            std::uint32_t first_edge = 0;
+            std::uint32_t edge_count = 0;
+            std::uint32_t value = 0; // index into _values plus one, zero means no signature ends here
+        };
+
+        struct edge
+        {
+            unsigned char byte;
+            std::uint32_t target;
+        };
+
+        std::vector<node> _nodes; // the root is the first one
+        std::vector<edge> _edges; // those of a node are contiguous and sorted
+        std::vector<Value> _values;
+        std::size_t _max_length = 0;
+
+        std::uint32_t build(const std::vector<entry>& entries, const std::vector<std::size_t>& order, std::size_t begin, std::size_t end, std::size_t depth)
+        {
+            // the range shares its first depth bytes, so the shortest signatures come first
+            const auto index = static_cast<std::uint32_t>(_nodes.size());
+            _nodes.emplace_back();
+            auto i = begin;
+            if (i < end && entries[order[i]].first.length() == depth)
+            {
+                _values.push_back(entries[order[i]].second); // the first of equal signatures wins
+                _nodes[index].value = static_cast<std::uint32_t>(_values.size());
+                while (i < end && entries[order[i]].first.length() == depth) { i++; }
+            }
+
+            // build a child for every distinct next byte, then append the edges in one piece
+            auto children = std::vector<edge>();
+            while (i < end)
+            {
+                const auto byte = static_cast<unsigned char>(entries[order[i]].first[depth]);
+                auto j = i;
+                while (j < end && static_cast<unsigned char>(entries[order[j]].first[depth]) == byte) { j++; }
+                children.push_back(edge{ byte, build(entries, order, i, j, depth + 1) });
+                i = j;
+            }
+            _nodes[index].first_edge = static_cast<std::uint32_t>(_edges.size());
+            _nodes[index].edge_count = static_cast<std::uint32_t>(children.size());
+            _edges.insert(_edges.end(), children.begin(), children.end());
+            return index;
+        }
+
+    public:
+        signature_trie() = default;
+
+        explicit signature_trie(const std::vector<entry>& entries) // empty signatures are ignored
+        {
+            if (entries.size() >= 0x40000000) { throw std::length_error("entries"); }
+
+            // sort the signatures, keeping the order of equal ones
+            auto order = std::vector<std::size_t>();
+            order.reserve(entries.size());
+            for (auto i = std::size_t(0); i < entries.size(); i++)
+            {
+                if (entries[i].first.empty()) { continue; }
+                order.push_back(i);
+                _max_length = std::max(_max_length, entries[i].first.length());
+            }
+            std::stable_sort(order.begin(), order.end(), [&entries](std::size_t a, std::size_t b) { return entries[a].first < entries[b].first; });
+            if (!order.empty()) { build(entries, order, 0, order.size(), 0); }
+        }
+
+        const Value* find(const void* header, std::size_t length) const noexcept
+        {
+            if (_nodes.empty()) { return nullptr; }
+            const auto bytes = static_cast<const unsigned char*>(header);
+            auto result = static_cast<const Value*>(nullptr);
+            auto current = &_nodes.front();
+            for (auto i = std::size_t(0);; i++)
+            {
+                if (current->value != 0) { result = &_values[current->value - 1]; }
+                if (i == length) { break; }
+
+                // few nodes have more than a handful of edges, so a linear search is fine
+                const auto first = _edges.begin() + current->first_edge;
+                const auto last = first + current->edge_count;
+                const auto next = std::find_if(first, last, [byte = bytes[i]](const edge& e) { return e.byte == byte; });
+                if (next == last) { break; }
+                current = &_nodes[next->target];
+            }
+            return result;
+        }
+
+        std::size_t max_length() const noexcept { return _max_length; }
+        bool empty() const noexcept { return _values.empty(); }
+    };
+}
@@ -0,0 +1,226 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "threads.hpp"
+
+#include "counters.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace threads
+{
+    static auto _reserved = std::atomic<LONGLONG>(0);
+    static auto _outstanding = std::atomic<size_t>(0);
+
+    struct executor
+    {
+        PTP_POOL pool = nullptr;
+        PTP_CLEANUP_GROUP cleanupGroup = nullptr;
+        TP_CALLBACK_ENVIRON environment;
+        DWORD maximum = 1; // set by limit_jobs, guarded by _executor_mutex (jobs that wait on anything but the CPU call begin_blocking)
+        DWORD blocking = 0; // jobs that called begin_blocking, guarded by _executor_mutex
+
+        executor()
+        {
+            // no minimum, so that an idle executor holds no threads
+            pool = ::CreateThreadpool(nullptr);
+            WIN32_DO_OR_THROW(pool);
+            cleanupGroup = ::CreateThreadpoolCleanupGroup();
+            if (cleanupGroup == nullptr)
+            {
+                const auto error = ::GetLastError();
+                ::CloseThreadpool(pool);
+                WIN32_THROW(error);
+            }
+            ::SetThreadpoolThreadMaximum(pool, maximum);
+            ::InitializeThreadpoolEnvironment(&environment);
+            ::SetThreadpoolCallbackPool(&environment, pool);
+            ::SetThreadpoolCallbackCleanupGroup(&environment, cleanupGroup, nullptr);
+            ::SetThreadpoolCallbackLibrary(&environment, utils::get_current_module().get()); // keeps the module loaded while a job runs
+        }
+
+        ~executor() noexcept
+        {
+            // without outstanding jobs all members are closed already, so this doesn't wait
+            ::CloseThreadpoolCleanupGroupMembers(cleanupGroup, TRUE, nullptr);
+            ::CloseThreadpoolCleanupGroup(cleanupGroup);
+            ::CloseThreadpool(pool);
+            ::DestroyThreadpoolEnvironment(&environment);
+        }
+
+        executor(const executor&) = delete;
+        executor& operator=(const executor&) = delete;
+
+        // called with _executor_mutex locked
+        void apply_maximum() noexcept
+        {
+            ::SetThreadpoolThreadMaximum(pool, maximum + blocking);
+        }
+    };
+
+    static auto _executor_mutex = std::mutex();
+    static auto _executor = static_cast<executor*>(nullptr); // not closed on process exit, when its threads are gone already
+
+    static auto _job_threads = DWORD(1); // applied once the executor gets created, guarded by _executor_mutex
+
+    static executor& get_executor()
+    {
+        const auto lock = std::lock_guard<std::mutex>(_executor_mutex);
+        if (_executor == nullptr)
+        {
+            _executor = new executor();
+            _executor->maximum = _job_threads;
+            _executor->apply_maximum();
+        }
+        return *_executor;
+    }
+
+    //----------------------------------------------------------------------------//
+
+    struct job::context
+    {
+        std::function<void()> work;
+        PTP_WORK handle = nullptr;
+    };
+
+    static void CALLBACK run_job(PTP_CALLBACK_INSTANCE instance, void* context, PTP_WORK work) noexcept
+    {
+        {
+            const auto job_context = std::unique_ptr<job::context>(static_cast<job::context*>(context));
+            try { job_context->work(); }
+            catch (...) {}
+        }
+        ::CloseThreadpoolWork(work); // freed once this callback returns
+        _outstanding--;
+    }
+
+    job::job(std::function<void()>&& work)
+    {
+        if (!work) { throw std::invalid_argument("work"); }
+        auto job_context = std::make_unique<context>();
+        job_context->work = std::move(work);
+        job_context->handle = ::CreateThreadpoolWork(run_job, job_context.get(), &get_executor().environment);
+        WIN32_DO_OR_THROW(job_context->handle);
+        _context = job_context.release();
+        _outstanding++;
+    }
+
+    job::job(job&& other) noexcept : _context(std::exchange(other._context, nullptr)) {}
+
+    job::~job() noexcept
+    {
+        if (_context == nullptr) { return; }
+        ::CloseThreadpoolWork(_context->handle); // never submitted, so there is no callback to wait for
+        delete _context;
+        _outstanding--;
+    }
+
+    job& job::operator=(job&& other) noexcept
+    {
+        if (this != &other)
+        {
+            auto dropped = job(std::move(*this));
+            _context = std::exchange(other._context, nullptr);
+        }
+        return *this;
+    }
+
+    void job::start() noexcept
+    {
+        assert(_context != nullptr);
+        ::SubmitThreadpoolWork(std::exchange(_context, nullptr)->handle); // cannot fail for a work object that isn't submitted yet
+    }
+
+    void begin_blocking() noexcept
+    {
+        const auto lock = std::lock_guard<std::mutex>(_executor_mutex);
+        if (_executor == nullptr) { return; } // only jobs block, so it must exist
+        _executor->blocking++;
+        _executor->apply_maximum();
+    }
+
+    void end_blocking() noexcept
+    {
+        const auto lock = std::lock_guard<std::mutex>(_executor_mutex);
+        if (_executor == nullptr || _executor->blocking == 0) { return; }
+        _executor->blocking--;
+        _executor->apply_maximum();
+    }
+
+    void limit_jobs(DWORD maximum) noexcept
+    {
+        const auto lock = std::lock_guard<std::mutex>(_executor_mutex);
+        _job_threads = std::max(maximum, DWORD(1));
+        if (_executor == nullptr) { return; }
+        _executor->maximum = _job_threads;
+        _executor->apply_maximum();
+    }
+
+    size_t outstanding() noexcept
+    {
+        return _outstanding;
+    }
+
+    void shutdown() noexcept
+    {
+        assert(_outstanding == 0);
+        const auto lock = std::lock_guard<std::mutex>(_executor_mutex);
+        delete std::exchange(_executor, nullptr);
+    }
+
+    //----------------------------------------------------------------------------//
+
+    static void release(ULONG count) noexcept
+    {
+        if (count == 0) { return; }
+        _reserved -= count;
+        counters::decrement(counters::counter::threads_reserved, count);
+    }
+
+    reservation::reservation(ULONG budget, ULONG maximum) noexcept
+    {
+        // take what's left of the budget, but at most the maximum (possibly nothing)
+        auto reserved = _reserved.load();
+        auto count = ULONG(0);
+        do
+        {
+            count = static_cast<ULONG>(std::clamp(static_cast<LONGLONG>(budget) - reserved, LONGLONG(0), static_cast<LONGLONG>(maximum)));
+        } while (!_reserved.compare_exchange_weak(reserved, reserved + count));
+        _count = count;
+        counters::increment(counters::counter::threads_reserved, _count);
+    }
+
+    reservation::reservation(reservation&& other) noexcept : _count(std::exchange(other._count, 0)) {}
+
+    reservation::~reservation() noexcept { release(_count); }
+
+    reservation& reservation::operator=(reservation&& other) noexcept
+    {
+        if (this != &other)
+        {
+            release(std::exchange(_count, std::exchange(other._count, 0)));
+        }
+        return *this;
+    }
+}
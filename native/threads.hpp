@@ -0,0 +1,72 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "win32.hpp"
+
+#include <functional>
+
+namespace threads
+{
+    class reservation // threads taken from a process-wide budget until destroyed, move-only
+    {
+    private:
+        ULONG _count = 0;
+
+    public:
+        reservation() noexcept = default;
+        reservation(ULONG budget, ULONG maximum) noexcept; // never blocks, so nothing is taken if all of the budget is reserved already
+        reservation(const reservation&) = delete;
+        reservation(reservation&& other) noexcept;
+        ~reservation() noexcept;
+
+        reservation& operator=(const reservation&) = delete;
+        reservation& operator=(reservation&& other) noexcept;
+
+        ULONG count() const noexcept { return _count; }
+    };
+
+    class job // work for the small shared executor, created up front so that starting it cannot fail, move-only
+    {
+    public:
+        struct context; // the work and its threadpool object
+
+    private:
+        context* _context = nullptr; // owned by the executor once started
+
+    public:
+        job() noexcept = default;
+        explicit job(std::function<void()>&& work); // throws if the executor cannot be created or has no room for the work
+        job(const job&) = delete;
+        job(job&& other) noexcept;
+        ~job() noexcept; // drops the work unless it got started
+
+        job& operator=(const job&) = delete;
+        job& operator=(job&& other) noexcept;
+
+        explicit operator bool() const noexcept { return _context != nullptr; }
+        void start() noexcept; // never runs the work right away, even if called from the executor, exceptions of the work are dropped
+    };
+
+    void begin_blocking() noexcept; // lets the executor run one more job while a running one waits on something that may need the executor itself
+    void end_blocking() noexcept; // called once for every begin_blocking, possibly from another thread
+    void limit_jobs(DWORD maximum) noexcept; // threads the executor runs jobs on (besides blocking ones), at least one
+    size_t outstanding() noexcept; // jobs that exist but haven't finished, the module must stay loaded until there are none
+    void shutdown() noexcept; // closes the executor, only allowed without any outstanding jobs (e.g. when the module gets unloaded)
+}
@@ -59,6 +59,16 @@ namespace win32
         ::UnmapViewOfFile(lpBaseAddress);
     }
 
+    void threadpool_io_deleter::operator()(PTP_IO pio) noexcept
+    {
+        ::CloseThreadpoolIo(pio); // the caller must have waited for all callbacks
+    }
+
+    void virtualmem_deleter::operator()(void* lpAddress) noexcept
+    {
+        ::VirtualFree(lpAddress, 0, MEM_RELEASE);
+    }
+
     /******************************************************************************/
 
     constexpr static const auto string_length = int(38);
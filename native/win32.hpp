@@ -133,6 +133,18 @@ namespace win32
     };
     using unique_fileview_ptr = std::unique_ptr<std::remove_pointer_t<LPVOID>, fileview_delete>;
 
+    struct threadpool_io_deleter
+    {
+        void operator()(PTP_IO) noexcept;
+    };
+    using unique_threadpool_io_ptr = std::unique_ptr<std::remove_pointer_t<PTP_IO>, threadpool_io_deleter>;
+
+    struct virtualmem_deleter
+    {
+        void operator()(void*) noexcept;
+    };
+    template <typename T> using unique_virtualmem_ptr = std::unique_ptr<T, virtualmem_deleter>;
+
     /******************************************************************************/
 
     // guid with string representation of {xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx}
@@ -18,38 +18,245 @@
 
 #include "FileBuffer.hpp"
 
+#include "counters.hpp"
 #include "settings.hpp"
+#include "threads.hpp"
+
+#include "SpillFile.hpp"
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <condition_variable>
-#include <filesystem>
+#include <iterator>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <stdexcept>
+#include <system_error>
 
 namespace streams
 {
+    constexpr static const auto StagingBufferCount = size_t(4); // at most that many writes are in flight
+    constexpr static const auto StagingBufferSize = ULONG(0x10000); // matches the allocation granularity
+
     CLASS_IMPLEMENTATION(FileBuffer,
-                         PIMPL_CONSTRUCTOR(const com::FileDescription& description) : Description(description), size(description.Size) {}
+                         PIMPL_CONSTRUCTOR(const com::FileDescription& description) : Description(description), size(description.Size)
+    {
+        for (auto& staging : stagingBuffers) { staging.owner = this; }
+    }
+    PIMPL_DECONSTRUCTOR()
+    {
+        // the staging buffers must outlive their writes
+        if (!spillFile) { return; }
+        counters::maximize(counters::counter::file_view_maps_per_item, fileViewMaps);
+        auto lock = std::unique_lock(m);
+        isWriterWaiting = true; // the last owner is waiting for the writes now
+        cv.wait(lock, [this] { return writesInFlight == 0; });
+        lock.unlock();
+        spillFile->WaitForWrites();
+    }
 public:
+    struct StagingBuffer : public SpillWrite
+    {
+        impl* owner = nullptr;
+        win32::unique_virtualmem_ptr<BYTE> data; // allocated on first use
+        ULONGLONG offset = 0;
+        ULONG length = 0;
+        bool isIssued = false; // until the buffer is retired
+        bool isWritten = false;
+
+        void Completed(DWORD error, ULONG_PTR bytesWritten) noexcept override;
+    };
+
+    struct FileView
+    {
+        ULONGLONG position;
+        std::shared_ptr<const void> view; // readers keep their own reference while copying
+    };
+
+    struct Continuation
+    {
+        ULONGLONG requiredSize;
+        threads::job resume;
+    };
+
+    void IssueStagingBuffer(); // writer only
+    void Publish(ULONGLONG newPosition); // dito, for memory buffers
+    bool ShouldWakeUp() const noexcept; // requires the lock
+    bool IsReadable(ULONGLONG requiredSize, ULONGLONG& currentPosition) noexcept; // dito, registers the reader if not
+    void TakeReadyContinuations(std::list<Continuation>& ready) noexcept; // dito, registers the remaining ones
+    static void Resume(std::list<Continuation>& ready) noexcept;
+    std::shared_ptr<const void> MapFileView(ULONGLONG startPosition);
+
     const com::FileDescription Description;
     const ULONGLONG size;
     std::mutex m;
     std::condition_variable cv;
     std::vector<BYTE> buffer;
-    win32::unique_handle_ptr fileHandle;
-    win32::unique_handle_ptr fileMapping;
-    ULARGE_INTEGER fileViewPosition;
+    std::optional<MappedFile> source;
+    ULONGLONG sourceOffset = 0;
+    std::optional<SpillFile> spillFile;
+    std::array<StagingBuffer, StagingBufferCount> stagingBuffers;
+    size_t oldestStagingBuffer = 0;
+    size_t writesInFlight = 0;
+    DWORD writeError = ERROR_SUCCESS;
+    bool isWriterWaiting = false;
+    size_t fillingStagingBuffer = 0; // writer only
+    ULONG fillingLength = 0; // dito
+    ULONGLONG appendPosition = 0; // dito
     SIZE_T fileViewSize;
-    win32::unique_fileview_ptr fileView;
-    ULONGLONG position = 0;
-    bool endOfFile = false;
+    size_t fileViewCount;
+    std::mutex viewMutex;
+    std::list<FileView> fileViews; // most recently used first
+    std::list<Continuation> continuations; // waiting like readers, but without a thread
+    ULONGLONG fileViewMaps = 0;
+    std::atomic<ULONGLONG> position = 0; // readable bytes, published by the writer or write completions
+    std::atomic<ULONGLONG> wakeUpPosition = MAXULONGLONG; // lowest position any waiting reader needs
+    std::atomic<bool> endOfFile = false;
     );
 
-    static void TryCreateTempFile(const std::filesystem::path path, win32::unique_handle_ptr& handle)
+    void FileBuffer::impl::StagingBuffer::Completed(DWORD error, ULONG_PTR bytesWritten) noexcept
+    {
+        auto ready = std::list<Continuation>();
+        {
+            const auto lock = std::lock_guard(owner->m);
+            owner->writesInFlight--;
+            if (error != ERROR_SUCCESS || bytesWritten != length)
+            {
+                owner->writeError = error != ERROR_SUCCESS ? error : ERROR_WRITE_FAULT;
+            }
+            else
+            {
+                isWritten = true;
+            }
+
+            // retire buffers in order, so that the readable bytes stay contiguous
+            while (true)
+            {
+                auto& oldest = owner->stagingBuffers[owner->oldestStagingBuffer];
+                if (!oldest.isIssued || !oldest.isWritten) { break; }
+                owner->position.store(oldest.offset + oldest.length);
+                oldest.isIssued = false;
+                oldest.isWritten = false;
+                owner->oldestStagingBuffer = (owner->oldestStagingBuffer + 1) % StagingBufferCount;
+            }
+            if (!owner->ShouldWakeUp()) { return; }
+            owner->wakeUpPosition.store(MAXULONGLONG);
+            owner->TakeReadyContinuations(ready);
+        }
+        owner->cv.notify_all();
+        counters::increment(counters::counter::buffer_wakeups);
+        Resume(ready);
+    }
+
+    bool FileBuffer::impl::ShouldWakeUp() const noexcept
+    {
+        // only wake up readers whose range got available, unless the state changed for everyone
+        return isWriterWaiting || writeError != ERROR_SUCCESS || (endOfFile.load() && writesInFlight == 0) || position.load() >= wakeUpPosition.load();
+    }
+
+    bool FileBuffer::impl::IsReadable(ULONGLONG requiredSize, ULONGLONG& currentPosition) noexcept
+    {
+        if (wakeUpPosition.load() > requiredSize) { wakeUpPosition.store(requiredSize); } // before loading the position, see Publish
+        currentPosition = position.load();
+        return currentPosition >= requiredSize || writeError != ERROR_SUCCESS || (endOfFile.load() && writesInFlight == 0);
+    }
+
+    void FileBuffer::impl::TakeReadyContinuations(std::list<Continuation>& ready) noexcept
     {
-        const auto filePath = path / utils::get_temp_file_name();
-        handle.reset(::CreateFileW(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr));
-        if (handle.get() == INVALID_HANDLE_VALUE) { handle.release(); }
+        auto currentPosition = ULONGLONG(0);
+        for (auto continuation = continuations.begin(); continuation != continuations.end();)
+        {
+            const auto next = std::next(continuation);
+            if (IsReadable(continuation->requiredSize, currentPosition))
+            {
+                ready.splice(ready.end(), continuations, continuation);
+            }
+            continuation = next;
+        }
+    }
+
+    void FileBuffer::impl::Resume(std::list<Continuation>& ready) noexcept
+    {
+        for (auto& continuation : ready)
+        {
+            continuation.resume.start(); // never inline, this might be a write completion that must not drop the buffer
+        }
+    }
+
+    void FileBuffer::impl::Publish(ULONGLONG newPosition)
+    {
+        // both stores and loads are sequentially consistent, so either the writer sees the wake up position or the reader the new position
+        position.store(newPosition);
+        if (newPosition < wakeUpPosition.load()) { return; }
+        auto ready = std::list<Continuation>();
+        {
+            const auto lock = std::lock_guard(m); // a reader is either about to check the position or already waiting
+            wakeUpPosition.store(MAXULONGLONG); // unsatisfied readers will register again
+            TakeReadyContinuations(ready); // continuations register right away
+        }
+        cv.notify_all();
+        counters::increment(counters::counter::buffer_wakeups);
+        Resume(ready);
+    }
+
+    void FileBuffer::impl::IssueStagingBuffer()
+    {
+        auto& staging = stagingBuffers[fillingStagingBuffer];
+        {
+            const auto lock = std::lock_guard(m);
+            staging.offset = appendPosition - fillingLength;
+            staging.length = fillingLength;
+            staging.isIssued = true;
+            writesInFlight++;
+        }
+        fillingStagingBuffer = (fillingStagingBuffer + 1) % StagingBufferCount;
+        fillingLength = 0;
+        try
+        {
+            spillFile->Write(staging, staging.offset, staging.data.get(), staging.length);
+        }
+        catch (const std::system_error& e)
+        {
+            // the buffer never gets retired, which stops readers at its offset
+            auto ready = std::list<Continuation>();
+            {
+                const auto lock = std::lock_guard(m);
+                writesInFlight--;
+                writeError = static_cast<DWORD>(e.code().value());
+                TakeReadyContinuations(ready);
+            }
+            cv.notify_all();
+            Resume(ready);
+            throw;
+        }
+    }
+
+    std::shared_ptr<const void> FileBuffer::impl::MapFileView(ULONGLONG startPosition)
+    {
+        const auto lock = std::lock_guard(viewMutex);
+
+        // move an already mapped window to the front
+        const auto existing = std::find_if(fileViews.begin(), fileViews.end(), [startPosition](const FileView& fileView) { return fileView.position == startPosition; });
+        if (existing != fileViews.end())
+        {
+            fileViews.splice(fileViews.begin(), fileViews, existing);
+            counters::increment(counters::counter::file_view_hits);
+            return existing->view;
+        }
+
+        // otherwise map the window and drop the least recently used one
+        auto viewPosition = ULARGE_INTEGER();
+        viewPosition.QuadPart = startPosition;
+        auto view = win32::unique_fileview_ptr(::MapViewOfFile(spillFile->FileMapping, FILE_MAP_READ, viewPosition.HighPart, viewPosition.LowPart, static_cast<SIZE_T>(std::min(static_cast<ULONGLONG>(fileViewSize), size - startPosition))));
+        WIN32_DO_OR_THROW(view);
+        fileViews.push_front(FileView{ startPosition, std::shared_ptr<const void>(view.release(), win32::fileview_delete()) });
+        if (fileViews.size() > fileViewCount) { fileViews.pop_back(); }
+        fileViewMaps++;
+        counters::increment(counters::counter::file_view_maps);
+        return fileViews.front().view;
     }
 
     FileBuffer::FileBuffer(const com::FileDescription& description) : PIMPL_INIT(description)
@@ -57,34 +264,15 @@ namespace streams
         const auto maxBufferSize = settings::maximum_buffer_size();
         if (PIMPL_(size) > maxBufferSize)
         {
-            // get the file view size
+            // get the file view size and count
             auto systemInfo = SYSTEM_INFO();
             ::GetSystemInfo(&systemInfo);
-            PIMPL_(fileViewSize) = std::max(maxBufferSize - (maxBufferSize % systemInfo.dwAllocationGranularity), static_cast<SIZE_T>(systemInfo.dwAllocationGranularity));
+            const auto viewSize = settings::file_view_size() > 0 ? settings::file_view_size() : maxBufferSize;
+            PIMPL_(fileViewSize) = std::max(viewSize - (viewSize % systemInfo.dwAllocationGranularity), static_cast<SIZE_T>(systemInfo.dwAllocationGranularity));
+            PIMPL_(fileViewCount) = std::max(settings::file_view_count(), DWORD(1));
 
-            // create a temporary file
-            const auto tempPath = utils::get_temp_path();
-            TryCreateTempFile(tempPath, PIMPL_(fileHandle)); // this will most likely fail under Windows Search since the default temp directory is not writable
-            if (!PIMPL_(fileHandle))
-            {
-                const auto lastError = ::GetLastError();
-                const auto systemTempPath = utils::get_system_temp_path();
-                if (tempPath == systemTempPath) { WIN32_THROW(lastError); } // no point in trying the same path twice
-                TryCreateTempFile(systemTempPath, PIMPL_(fileHandle));
-                if (!PIMPL_(fileHandle)) { WIN32_THROW(lastError); } // better throw the original error
-            }
-
-            // extend the file to the full size
-            auto endOfFilePosition = LARGE_INTEGER();
-            endOfFilePosition.QuadPart = PIMPL_(size);
-            WIN32_DO_OR_THROW(::SetFilePointerEx(PIMPL_(fileHandle).get(), endOfFilePosition, nullptr, FILE_BEGIN));
-            WIN32_DO_OR_THROW(::SetEndOfFile(PIMPL_(fileHandle).get()));
-            WIN32_DO_OR_THROW(::SetFilePointerEx(PIMPL_(fileHandle).get(), LARGE_INTEGER(), nullptr, FILE_BEGIN));
-
-            // map the file to allow simultaneous reading
-            PIMPL_(fileMapping).reset(::CreateFileMappingW(PIMPL_(fileHandle).get(), nullptr, PAGE_READONLY, endOfFilePosition.HighPart, endOfFilePosition.LowPart, nullptr));
-            if (PIMPL_(fileMapping).get() == INVALID_HANDLE_VALUE) { PIMPL_(fileMapping).release(); }
-            WIN32_DO_OR_THROW(PIMPL_(fileMapping));
+            // borrow a file from the spill pool, which also maps it
+            PIMPL_(spillFile).emplace(PIMPL_(size));
         }
         else
         {
@@ -92,6 +280,18 @@ namespace streams
         }
     }
 
+    FileBuffer::FileBuffer(const com::FileDescription& description, const MappedFile& source, ULONGLONG sourceOffset) : PIMPL_INIT(description)
+    {
+        if (sourceOffset > source.Size || PIMPL_(size) > source.Size - sourceOffset) { throw std::out_of_range("sourceOffset"); }
+
+        // everything is available from the start, nothing gets appended
+        PIMPL_(source) = source;
+        PIMPL_(sourceOffset) = sourceOffset;
+        PIMPL_(appendPosition) = PIMPL_(size);
+        PIMPL_(position).store(PIMPL_(size));
+        PIMPL_(endOfFile).store(true);
+    }
+
     PIMPL_GETTER(FileBuffer, const com::FileDescription&, Description);
 
     ULONG FileBuffer::Append(const void* buffer, ULONG count)
@@ -99,84 +299,74 @@ namespace streams
         if (buffer == nullptr) { throw std::invalid_argument("buffer"); }
 
         // preliminary checks
-        PIMPL_LOCK_BEGIN(m);
-        if (PIMPL_(endOfFile)) { COM_THROW(E_ABORT); } // no further file writes are allowed
-        PIMPL_LOCK_END;
-        if (PIMPL_(position) >= PIMPL_(size)) { return 0; } // no writes beyond the size
-        const auto bytesToWrite = static_cast<ULONG>(std::min(PIMPL_(size) - PIMPL_(position), static_cast<ULONGLONG>(count))); // limit to available size
+        if (PIMPL_(endOfFile).load()) { COM_THROW(E_ABORT); } // no further file writes are allowed
+        if (PIMPL_(appendPosition) >= PIMPL_(size)) { return 0; } // no writes beyond the size
+        const auto bytesToWrite = static_cast<ULONG>(std::min(PIMPL_(size) - PIMPL_(appendPosition), static_cast<ULONGLONG>(count))); // limit to available size
+
+        // memory buffers are readable right away
+        if (!PIMPL_(spillFile))
+        {
+            std::memcpy(PIMPL_(buffer).data() + PIMPL_(appendPosition), buffer, bytesToWrite);
+            PIMPL_(appendPosition) += bytesToWrite;
+            PIMPL_(Publish)(PIMPL_(appendPosition));
+            return bytesToWrite;
+        }
 
-        // write the data and advance the position if successful
+        // otherwise stage the data and write full buffers asynchronously
         auto bytesWritten = ULONG(0);
-        if (PIMPL_(fileHandle))
+        while (bytesWritten < bytesToWrite)
         {
-            auto bytesToWriteRemaining = static_cast<DWORD>(bytesToWrite);
-            auto startPosition = LARGE_INTEGER();
-            startPosition.QuadPart = PIMPL_(position);
-            WIN32_DO_OR_THROW(::SetFilePointerEx(PIMPL_(fileHandle).get(), startPosition, nullptr, FILE_BEGIN));
-            while (bytesToWriteRemaining > 0)
+            auto& staging = PIMPL_(stagingBuffers)[PIMPL_(fillingStagingBuffer)];
+            if (PIMPL_(fillingLength) == 0)
             {
-                auto nativeBytesWritten = DWORD();
-                WIN32_DO_OR_THROW(::WriteFile(PIMPL_(fileHandle).get(), reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(buffer) + bytesWritten), bytesToWriteRemaining, &nativeBytesWritten, nullptr));
-                if (nativeBytesWritten == 0) { break; } // EOF reached
-                if (nativeBytesWritten > bytesToWriteRemaining) { COM_THROW(E_UNEXPECTED); } // sanity check, just to be sure
-                bytesWritten += nativeBytesWritten;
-                bytesToWriteRemaining -= nativeBytesWritten;
+                // only block if all buffers are still being written
+                PIMPL_LOCK_BEGIN(m);
+                PIMPL_(isWriterWaiting) = true;
+                PIMPL_WAIT(m, cv, !staging.isIssued || PIMPL_(writeError) != ERROR_SUCCESS);
+                PIMPL_(isWriterWaiting) = false;
+                if (PIMPL_(writeError) != ERROR_SUCCESS) { WIN32_THROW(PIMPL_(writeError)); }
+                PIMPL_LOCK_END;
+                if (!staging.data)
+                {
+                    staging.data.reset(reinterpret_cast<BYTE*>(::VirtualAlloc(nullptr, StagingBufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE)));
+                    WIN32_DO_OR_THROW(staging.data);
+                }
+            }
+            const auto bytesToStage = std::min(StagingBufferSize - PIMPL_(fillingLength), bytesToWrite - bytesWritten);
+            std::memcpy(staging.data.get() + PIMPL_(fillingLength), reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(buffer) + bytesWritten), bytesToStage);
+            PIMPL_(fillingLength) += bytesToStage;
+            PIMPL_(appendPosition) += bytesToStage;
+            bytesWritten += bytesToStage;
+            if (PIMPL_(fillingLength) == StagingBufferSize || PIMPL_(appendPosition) == PIMPL_(size))
+            {
+                PIMPL_(IssueStagingBuffer)();
             }
         }
-        else
-        {
-            std::memcpy(PIMPL_(buffer).data() + PIMPL_(position), buffer, bytesToWrite);
-            bytesWritten = bytesToWrite;
-        }
-
-        // increment the position and notify all listeners
-        PIMPL_LOCK_BEGIN(m);
-        PIMPL_(position) += bytesWritten;
-        PIMPL_LOCK_END;
-        PIMPL_(cv).notify_all();
-
         return bytesWritten;
     }
 
     ULONG FileBuffer::Read(ULONGLONG offset, void* buffer, ULONG count) const
     {
         if (buffer == nullptr) { throw std::invalid_argument("buffer"); }
-        if (MAXULONGLONG - offset < count) { throw std::length_error("offset + count"); }
-
-        // preliminary checks
-        if (offset >= PIMPL_(size)) { return 0; }
-        auto availableBytes = PIMPL_(size) - offset;
-        PIMPL_LOCK_BEGIN(m);
-        const auto requiredSize = std::min(offset + count, PIMPL_(size));
-        PIMPL_WAIT(m, cv, PIMPL_(position) >= requiredSize || PIMPL_(endOfFile));
-        if (PIMPL_(position) < requiredSize)
-        {
-            if (PIMPL_(position) <= offset) { return 0; } // will not become available anymore
-            availableBytes = PIMPL_(position) - offset;
-        }
-        PIMPL_LOCK_END;
-        const auto bytesToRead = static_cast<ULONG>(std::min(availableBytes, static_cast<ULONGLONG>(count))); // limit to available size
 
         // read the data
+        const auto bytesToRead = WaitForBytes(offset, count);
         auto bytesRead = ULONG(0);
-        if (PIMPL_(fileHandle))
+        if (PIMPL_(source))
+        {
+            if (!PIMPL_(source)->Read(PIMPL_(sourceOffset) + offset, buffer, bytesToRead)) { WIN32_THROW(ERROR_READ_FAULT); }
+            bytesRead = bytesToRead;
+        }
+        else if (PIMPL_(spillFile))
         {
             auto bytesToReadRemaining = static_cast<SIZE_T>(bytesToRead);
             while (bytesToReadRemaining > 0)
             {
                 const auto currentOffset = offset + bytesRead;
                 const auto bytesBeforeOffset = static_cast<SIZE_T>(currentOffset % PIMPL_(fileViewSize));
-                const auto startPosition = currentOffset - bytesBeforeOffset;
-                if (!PIMPL_(fileView) || PIMPL_(fileViewPosition).QuadPart != startPosition)
-                {
-                    // map another region of the file
-                    PIMPL_(fileView).reset();
-                    PIMPL_(fileViewPosition).QuadPart = startPosition;
-                    PIMPL_(fileView).reset(::MapViewOfFile(PIMPL_(fileMapping).get(), FILE_MAP_READ, PIMPL_(fileViewPosition).HighPart, PIMPL_(fileViewPosition).LowPart, static_cast<SIZE_T>(std::min(static_cast<ULONGLONG>(PIMPL_(fileViewSize)), PIMPL_(size) - startPosition))));
-                    WIN32_DO_OR_THROW(PIMPL_(fileView));
-                }
+                const auto fileView = PIMPL_(MapFileView)(currentOffset - bytesBeforeOffset);
                 const auto bytesToReadThisPass = static_cast<ULONG>(std::min(PIMPL_(fileViewSize) - bytesBeforeOffset, bytesToReadRemaining));
-                std::memcpy(reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(buffer) + bytesRead), reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(PIMPL_(fileView).get()) + bytesBeforeOffset), bytesToReadThisPass);
+                std::memcpy(reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(buffer) + bytesRead), reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(fileView.get()) + bytesBeforeOffset), bytesToReadThisPass);
                 bytesRead += bytesToReadThisPass;
                 bytesToReadRemaining -= bytesToReadThisPass;
             }
@@ -190,11 +380,71 @@ namespace streams
         return bytesRead;
     }
 
+    std::shared_ptr<const BYTE> FileBuffer::Peek(ULONGLONG offset, ULONG count, ULONG& length) const
+    {
+        length = WaitForBytes(offset, count);
+        if (length == 0 || PIMPL_(source)) { return nullptr; } // the source might raise read errors that the caller cannot handle
+        if (PIMPL_(spillFile))
+        {
+            // stop at the end of the window, which the result keeps mapped
+            const auto bytesBeforeOffset = static_cast<SIZE_T>(offset % PIMPL_(fileViewSize));
+            const auto fileView = PIMPL_(MapFileView)(offset - bytesBeforeOffset);
+            length = static_cast<ULONG>(std::min(PIMPL_(fileViewSize) - bytesBeforeOffset, static_cast<SIZE_T>(length)));
+            return std::shared_ptr<const BYTE>(fileView, reinterpret_cast<const BYTE*>(fileView.get()) + bytesBeforeOffset);
+        }
+        return std::shared_ptr<const BYTE>(pImpl, PIMPL_(buffer).data() + offset); // the memory buffer never moves
+    }
+
+    ULONG FileBuffer::WaitForBytes(ULONGLONG offset, ULONG count) const
+    {
+        if (MAXULONGLONG - offset < count) { throw std::length_error("offset + count"); }
+
+        // preliminary checks
+        if (offset >= PIMPL_(size)) { return 0; }
+        const auto requiredSize = std::min(offset + count, PIMPL_(size));
+        auto position = PIMPL_(position).load(std::memory_order_acquire);
+        if (position < requiredSize)
+        {
+            // register the required position and wait until the writer publishes it or nothing else is going to be written
+            PIMPL_LOCK_BEGIN(m);
+            PIMPL_WAIT(m, cv, PIMPL_(IsReadable)(requiredSize, position));
+            PIMPL_LOCK_END;
+            counters::increment(counters::counter::buffer_reads_waited);
+            if (position <= offset) { return 0; } // will not become available anymore
+        }
+        const auto availableBytes = std::min(position, PIMPL_(size)) - offset;
+        return static_cast<ULONG>(std::min(availableBytes, static_cast<ULONGLONG>(count))); // limit to available size
+    }
+
     void FileBuffer::SetEndOfFile()
     {
+        // write out what is left (any error is seen by the readers)
+        if (PIMPL_(spillFile) && PIMPL_(fillingLength) > 0)
+        {
+            try { PIMPL_(IssueStagingBuffer)(); }
+            catch (...) {}
+        }
+
+        auto ready = std::list<impl::Continuation>();
         PIMPL_LOCK_BEGIN(m);
-        PIMPL_(endOfFile) = true;
+        PIMPL_(endOfFile).store(true);
+        PIMPL_(TakeReadyContinuations)(ready);
         PIMPL_LOCK_END;
         PIMPL_(cv).notify_all();
+        impl::Resume(ready);
+    }
+
+    void FileBuffer::WhenReadable(ULONGLONG offset, ULONG count, threads::job&& continuation) const
+    {
+        if (!continuation) { throw std::invalid_argument("continuation"); }
+        if (MAXULONGLONG - offset < count) { throw std::length_error("offset + count"); }
+
+        // same range as WaitForBytes, the continuation gets started right away if it's already available
+        auto ready = std::list<impl::Continuation>();
+        PIMPL_LOCK_BEGIN(m);
+        PIMPL_(continuations).push_back(impl::Continuation{ offset >= PIMPL_(size) ? 0 : std::min(offset + count, PIMPL_(size)), std::move(continuation) });
+        PIMPL_(TakeReadyContinuations)(ready);
+        PIMPL_LOCK_END;
+        impl::Resume(ready);
     }
 }
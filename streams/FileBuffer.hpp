@@ -19,24 +19,34 @@
 #pragma once
 
 #include "pimpl.hpp"
+#include "threads.hpp"
 #include "win32.hpp"
 
 #include "FileDescription.hpp"
+#include "MappedFile.hpp"
+
+#include <memory>
 
 namespace streams
 {
-    class FileBuffer; // memory or disk-backed buffer for extracted files
+    class FileBuffer; // memory or disk-backed buffer for extracted files, or a window onto stored ones
 
     /******************************************************************************/
 
     CLASS_DECLARATION(FileBuffer,
 public:
     explicit FileBuffer(const com::FileDescription& description);
+    FileBuffer(const com::FileDescription& description, const MappedFile& source, ULONGLONG sourceOffset); // complete buffer over a stored range of the source
 
     PROPERTY_READONLY(const com::FileDescription&, Description, PIMPL_GETTER_ATTRIB);
 
-    ULONG Append(const void* buffer, ULONG count); // tries to write the most bytes
+    ULONG Append(const void* buffer, ULONG count); // tries to write the most bytes, disk writes complete asynchronously
     ULONG Read(ULONGLONG offset, void* buffer, ULONG count) const; // tries to write the most bytes
-    void SetEndOfFile(); // will not call COM
+    std::shared_ptr<const BYTE> Peek(ULONGLONG offset, ULONG count, ULONG& length) const; // contiguous bytes kept alive by the result, nullptr with a non-zero length if the storage cannot be referenced
+    void SetEndOfFile(); // will not call COM, must be called by the writer
+    void WhenReadable(ULONGLONG offset, ULONG count, threads::job&& continuation) const; // starts the continuation once Read wouldn't wait for the range, the buffer keeps it until then and drops it unstarted if destroyed before
+
+private:
+    ULONG WaitForBytes(ULONGLONG offset, ULONG count) const; // waits only for bytes not written yet, returns how many will be available
     );
 }
@@ -0,0 +1,99 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "HeaderStream.hpp"
+
+#include <algorithm>
+
+namespace streams
+{
+    CLASS_IMPLEMENTATION(HeaderStream,
+                         PIMPL_CONSTRUCTOR(std::vector<BYTE>& header, ULONG headerSize, Resolver&& resolver) : header(header), headerSize(headerSize), resolver(std::move(resolver)) {}
+public:
+    std::vector<BYTE>& header;
+    const ULONG headerSize;
+    Resolver resolver;
+    bool isResolved = false;
+    sevenzip::ISequentialOutStreamPtr target; // only set if resolved to a stream
+
+    void Resolve()
+    {
+        isResolved = true;
+        target = resolver(header.data(), static_cast<ULONG>(header.size()));
+        resolver = nullptr; // release anything captured
+
+        // hand the header to the target as well
+        auto written = size_t(0);
+        while (target && written < header.size())
+        {
+            auto processedSize = UINT32(0);
+            COM_DO_OR_THROW(target->Write(header.data() + written, static_cast<UINT32>(header.size() - written), &processedSize));
+            if (processedSize == 0) { break; } // the target takes no more
+            written += processedSize;
+        }
+    }
+    );
+
+    HeaderStream::HeaderStream(std::vector<BYTE>& header, ULONG headerSize, Resolver&& resolver) : PIMPL_INIT(header, headerSize, std::move(resolver))
+    {
+        PIMPL_(header).clear(); // keeps the capacity
+    }
+
+    STDMETHODIMP HeaderStream::Write(const void* data, UINT32 size, UINT32* processedSize) noexcept
+    {
+        COM_CHECK_POINTER(data);
+        if (processedSize != nullptr) { *processedSize = 0; }
+        COM_NOTHROW_BEGIN;
+
+        // collect the header first
+        auto bytes = static_cast<const BYTE*>(data);
+        auto remaining = size;
+        if (!PIMPL_(isResolved))
+        {
+            const auto bytesToCollect = std::min(remaining, static_cast<UINT32>(PIMPL_(headerSize) - PIMPL_(header).size()));
+            PIMPL_(header).insert(PIMPL_(header).end(), bytes, bytes + bytesToCollect);
+            bytes += bytesToCollect;
+            remaining -= bytesToCollect;
+            if (PIMPL_(header).size() < PIMPL_(headerSize))
+            {
+                if (processedSize != nullptr) { *processedSize = size; }
+                return S_OK;
+            }
+            PIMPL_(Resolve)();
+        }
+
+        // then pass on or drop the rest
+        auto bytesWritten = remaining;
+        if (PIMPL_(target) && remaining > 0)
+        {
+            COM_DO_OR_RETURN(PIMPL_(target)->Write(bytes, remaining, &bytesWritten));
+        }
+        if (processedSize != nullptr) { *processedSize = size - remaining + bytesWritten; }
+        return bytesWritten < remaining ? S_FALSE : S_OK;
+
+        COM_NOTHROW_END;
+    }
+
+    void HeaderStream::Flush()
+    {
+        if (!PIMPL_(isResolved))
+        {
+            PIMPL_(Resolve)();
+        }
+    }
+}
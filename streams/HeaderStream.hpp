@@ -0,0 +1,44 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "com.hpp"
+#include "pimpl.hpp"
+#include "sevenzip.hpp"
+
+#include <functional>
+#include <vector>
+
+namespace streams
+{
+    class HeaderStream; // provides an sevenzip::ISequentialOutStream writer that collects the first bytes of an item before deciding where the item goes
+
+    /******************************************************************************/
+
+    COM_CLASS_DECLARATION(HeaderStream, (sevenzip::ISequentialOutStream),
+public:
+    using Resolver = std::function<sevenzip::ISequentialOutStreamPtr(const BYTE* header, ULONG length)>; // returns the stream for the header and the rest, or nullptr to drop them
+
+    HeaderStream(std::vector<BYTE>& header, ULONG headerSize, Resolver&& resolver); // the header storage is reused and must outlive the stream's writes
+
+    STDMETHOD(Write)(const void* data, UINT32 size, UINT32* processedSize) noexcept override;
+
+    void Flush(); // resolves with the bytes collected so far if the item ended before the header was complete, throws whatever the resolver throws
+    );
+}
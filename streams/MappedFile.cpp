@@ -0,0 +1,153 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <mutex>
+
+namespace streams
+{
+    constexpr auto ViewSize = SIZE_T(sizeof(void*) > 4 ? 1 << 26 : 1 << 24); // multiple of the allocation granularity, small enough for 32-bit address spaces
+    constexpr auto ViewCount = size_t(4); // one for the decoder, the rest for sub-filters reading stored items
+    constexpr auto ReadAheadSize = SIZE_T(1 << 22); // how far the pages ahead of the last read get prefetched
+
+    CLASS_IMPLEMENTATION(MappedFile,
+public:
+    struct FileView
+    {
+        ULONGLONG position;
+        std::shared_ptr<const void> view; // readers keep their own reference while copying
+        std::atomic<SIZE_T> prefetchedEnd = 0; // relative to the view
+    };
+
+    std::shared_ptr<FileView> MapFileView(ULONGLONG startPosition) noexcept;
+    void Prefetch(FileView& fileView, SIZE_T readEnd) const noexcept;
+
+    win32::unique_handle_ptr fileHandle;
+    win32::unique_handle_ptr fileMapping;
+    ULONGLONG Size;
+    std::mutex viewMutex;
+    std::list<std::shared_ptr<FileView>> fileViews; // most recently used first
+    );
+
+    static bool CopyFromView(void* destination, const void* source, size_t count) noexcept
+    {
+        // reading from a view raises an exception instead of an error if the underlying file cannot be read
+        __try
+        {
+            std::memcpy(destination, source, count);
+            return true;
+        }
+        __except (::GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+        {
+            return false;
+        }
+    }
+
+    std::shared_ptr<MappedFile::impl::FileView> MappedFile::impl::MapFileView(ULONGLONG startPosition) noexcept
+    {
+        const auto lock = std::lock_guard(viewMutex);
+
+        // move an already mapped window to the front
+        const auto existing = std::find_if(fileViews.begin(), fileViews.end(), [startPosition](const std::shared_ptr<FileView>& fileView) { return fileView->position == startPosition; });
+        if (existing != fileViews.end())
+        {
+            fileViews.splice(fileViews.begin(), fileViews, existing);
+            return fileViews.front();
+        }
+
+        // otherwise map the window and drop the least recently used one
+        auto viewPosition = ULARGE_INTEGER();
+        viewPosition.QuadPart = startPosition;
+        auto view = win32::unique_fileview_ptr(::MapViewOfFile(fileMapping.get(), FILE_MAP_READ, viewPosition.HighPart, viewPosition.LowPart, static_cast<SIZE_T>(std::min(static_cast<ULONGLONG>(ViewSize), Size - startPosition))));
+        if (!view) { return nullptr; }
+        try
+        {
+            auto fileView = std::make_shared<FileView>();
+            fileView->position = startPosition;
+            fileView->view = std::shared_ptr<const void>(view.get(), win32::fileview_delete());
+            view.release();
+            fileViews.push_front(std::move(fileView));
+        }
+        catch (const std::bad_alloc&) { return nullptr; }
+        if (fileViews.size() > ViewCount) { fileViews.pop_back(); }
+        return fileViews.front();
+    }
+
+    void MappedFile::impl::Prefetch(FileView& fileView, SIZE_T readEnd) const noexcept
+    {
+        // not available before Windows 8, where the pages simply get faulted in on demand
+        static const auto prefetchVirtualMemory = reinterpret_cast<decltype(&::PrefetchVirtualMemory)>(::GetProcAddress(::GetModuleHandleW(L"kernel32.dll"), "PrefetchVirtualMemory"));
+        if (prefetchVirtualMemory == nullptr) { return; }
+
+        // only the reader that first gets within half the read-ahead distance of the prefetched end issues the next range
+        const auto viewSize = static_cast<SIZE_T>(std::min(static_cast<ULONGLONG>(ViewSize), Size - fileView.position));
+        auto prefetchedEnd = fileView.prefetchedEnd.load();
+        do
+        {
+            if (prefetchedEnd >= viewSize || readEnd + ReadAheadSize / 2 < prefetchedEnd) { return; }
+        } while (!fileView.prefetchedEnd.compare_exchange_weak(prefetchedEnd, std::min(std::max(prefetchedEnd, readEnd) + ReadAheadSize, viewSize)));
+        const auto start = std::max(prefetchedEnd, readEnd);
+        auto range = WIN32_MEMORY_RANGE_ENTRY();
+        range.VirtualAddress = reinterpret_cast<PVOID>(reinterpret_cast<uintptr_t>(fileView.view.get()) + start);
+        range.NumberOfBytes = std::min(start + ReadAheadSize, viewSize) - start;
+        if (range.NumberOfBytes > 0) { prefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0); } // only a hint, so errors don't matter
+    }
+
+    MappedFile::MappedFile(const std::filesystem::path& path) : PIMPL_INIT()
+    {
+        // open the file (FILE_FLAG_SEQUENTIAL_SCAN would only affect ReadFile, views are prefetched instead)
+        PIMPL_(fileHandle).reset(::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+        if (PIMPL_(fileHandle).get() == INVALID_HANDLE_VALUE) { PIMPL_(fileHandle).release(); }
+        WIN32_DO_OR_THROW(PIMPL_(fileHandle));
+        auto fileSize = LARGE_INTEGER();
+        WIN32_DO_OR_THROW(::GetFileSizeEx(PIMPL_(fileHandle).get(), &fileSize));
+        PIMPL_(Size) = fileSize.QuadPart;
+
+        // create the mapping (fails for empty files, which aren't archives anyway), windows get mapped on demand
+        PIMPL_(fileMapping).reset(::CreateFileMappingW(PIMPL_(fileHandle).get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+        if (PIMPL_(fileMapping).get() == INVALID_HANDLE_VALUE) { PIMPL_(fileMapping).release(); }
+        WIN32_DO_OR_THROW(PIMPL_(fileMapping));
+    }
+
+    PIMPL_GETTER(MappedFile, ULONGLONG, Size);
+
+    bool MappedFile::Read(ULONGLONG offset, void* buffer, SIZE_T count) const noexcept
+    {
+        if (offset > PIMPL_(Size) || count > PIMPL_(Size) - offset) { return false; }
+
+        // copy window by window, a read might straddle two of them
+        while (count > 0)
+        {
+            const auto viewPosition = offset - (offset % ViewSize);
+            const auto fileView = PIMPL_(MapFileView)(viewPosition);
+            if (!fileView) { return false; }
+            const auto viewOffset = static_cast<SIZE_T>(offset - viewPosition);
+            const auto bytesToCopy = std::min(count, ViewSize - viewOffset);
+            if (!CopyFromView(buffer, reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(fileView->view.get()) + viewOffset), bytesToCopy)) { return false; }
+            PIMPL_(Prefetch)(*fileView, viewOffset + bytesToCopy);
+            offset += bytesToCopy;
+            buffer = reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(buffer) + bytesToCopy);
+            count -= bytesToCopy;
+        }
+        return true;
+    }
+}
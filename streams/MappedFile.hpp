@@ -0,0 +1,40 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pimpl.hpp"
+#include "win32.hpp"
+
+#include <filesystem>
+
+namespace streams
+{
+    class MappedFile; // read-only windowed mapping of an entire file, shared by all its readers
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION(MappedFile,
+public:
+    explicit MappedFile(const std::filesystem::path& path);
+
+    PROPERTY_READONLY(ULONGLONG, Size, PIMPL_GETTER_ATTRIB);
+
+    bool Read(ULONGLONG offset, void* buffer, SIZE_T count) const noexcept; // false if the range is invalid or the file cannot be read, safe to call from any thread
+    );
+}
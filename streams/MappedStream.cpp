@@ -0,0 +1,74 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MappedStream.hpp"
+
+#include <algorithm>
+
+namespace streams
+{
+    CLASS_IMPLEMENTATION(MappedStream,
+                         PIMPL_CONSTRUCTOR(const MappedFile& file) : file(file) {}
+public:
+    const MappedFile file;
+    ULONGLONG position = 0;
+    );
+
+    MappedStream::MappedStream(const MappedFile& file) : PIMPL_INIT(file) {}
+
+    STDMETHODIMP MappedStream::Read(void* data, UINT32 size, UINT32* processedSize) noexcept
+    {
+        if (processedSize != nullptr) { *processedSize = 0; }
+        if (size == 0 || PIMPL_(position) >= PIMPL_(file).Size) { return S_OK; } // nothing to read
+        COM_CHECK_POINTER(data);
+
+        // copy straight from the view
+        const auto bytesToRead = static_cast<UINT32>(std::min(PIMPL_(file).Size - PIMPL_(position), static_cast<ULONGLONG>(size)));
+        if (!PIMPL_(file).Read(PIMPL_(position), data, bytesToRead)) { return STG_E_READFAULT; }
+        PIMPL_(position) += bytesToRead;
+        if (processedSize != nullptr) { *processedSize = bytesToRead; }
+        return S_OK;
+    }
+
+    STDMETHODIMP MappedStream::Seek(INT64 offset, UINT32 seekOrigin, UINT64* newPosition) noexcept
+    {
+        if (newPosition != nullptr) { *newPosition = PIMPL_(position); }
+
+        // get the starting position
+        ULONGLONG start;
+        switch (seekOrigin)
+        {
+        case STREAM_SEEK_SET: start = 0; break;
+        case STREAM_SEEK_CUR: start = PIMPL_(position); break;
+        case STREAM_SEEK_END: start = PIMPL_(file).Size; break;
+        default: return STG_E_INVALIDFUNCTION;
+        }
+
+        // seeking before the start is illegal, seeking beyond the end is not
+        if (offset < 0 && static_cast<ULONGLONG>(-offset) > start) { return HRESULT_FROM_WIN32(ERROR_NEGATIVE_SEEK); }
+        PIMPL_(position) = start + offset;
+        if (newPosition != nullptr) { *newPosition = PIMPL_(position); }
+        return S_OK;
+    }
+
+    STDMETHODIMP MappedStream::GetSize(UINT64* size) noexcept
+    {
+        COM_CHECK_POINTER_AND_SET(size, PIMPL_(file).Size);
+        return S_OK;
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "com.hpp"
+#include "pimpl.hpp"
+#include "sevenzip.hpp"
+
+#include "MappedFile.hpp"
+
+namespace streams
+{
+    class MappedStream; // allows 7-Zip to read directly from a mapped file
+
+    /******************************************************************************/
+
+    COM_CLASS_DECLARATION(MappedStream, (sevenzip::IInStream, sevenzip::IStreamGetSize),
+public:
+    explicit MappedStream(const MappedFile& file);
+
+    STDMETHOD(Read)(void* data, UINT32 size, UINT32* processedSize) noexcept override;
+    STDMETHOD(Seek)(INT64 offset, UINT32 seekOrigin, UINT64* newPosition) noexcept override;
+    STDMETHOD(GetSize)(UINT64* size) noexcept override;
+    );
+}
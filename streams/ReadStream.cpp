@@ -22,14 +22,16 @@
 
 namespace streams
 {
+    constexpr static const auto CopyToBlockSize = ULONG(0x100000); // the most bytes handed to the target stream at once
+
     CLASS_IMPLEMENTATION(ReadStream,
-                         PIMPL_CONSTRUCTOR(FileBuffer& buffer) : buffer(buffer) {}
+                         PIMPL_CONSTRUCTOR(FileBuffer& buffer, ULONGLONG position) : buffer(buffer), position(position) {}
 public:
     FileBuffer buffer;
-    ULONGLONG position = 0;
+    ULONGLONG position; // like any IStream cursor not meant to be shared across threads, each thread should use its own clone
     );
 
-    ReadStream::ReadStream(FileBuffer& buffer) : PIMPL_INIT(buffer) {}
+    ReadStream::ReadStream(FileBuffer& buffer, ULONGLONG position) : PIMPL_INIT(buffer, position) {}
 
     STDMETHODIMP ReadStream::Read(void* pv, ULONG cb, ULONG* pcbRead) noexcept
     {
@@ -95,8 +97,31 @@ namespace streams
         COM_CHECK_POINTER(pstm);
         if (pcbRead != nullptr) { pcbRead->QuadPart = 0; }
         if (pcbWritten != nullptr) { pcbWritten->QuadPart = 0; }
-        char buffer[8000];
         auto bytesToCopyRemaining = cb.QuadPart;
+        COM_NOTHROW_BEGIN;
+
+        // hand the buffer's storage straight to the target in large blocks
+        while (bytesToCopyRemaining > 0)
+        {
+            const auto bytesToPeek = static_cast<ULONG>(std::min(bytesToCopyRemaining, static_cast<ULONGLONG>(CopyToBlockSize)));
+            auto bytesPeeked = ULONG(0);
+            const auto span = PIMPL_(buffer).Peek(PIMPL_(position), bytesToPeek, bytesPeeked);
+            if (bytesPeeked == 0) { return S_FALSE; } // EOF
+            if (!span) { break; } // the storage cannot be referenced, copy through a buffer instead
+            PIMPL_(position) += bytesPeeked;
+            if (pcbRead != nullptr) { pcbRead->QuadPart += bytesPeeked; }
+
+            // write operation
+            auto bytesWritten = ULONG(0);
+            COM_DO_OR_RETURN(pstm->Write(span.get(), bytesPeeked, &bytesWritten));
+            if (pcbWritten != nullptr) { pcbWritten->QuadPart += bytesWritten; }
+            if (bytesWritten < bytesPeeked) { return S_FALSE; }
+            bytesToCopyRemaining -= bytesPeeked; // the span may have ended early at a window boundary, so don't check for EOF here
+        }
+
+        COM_NOTHROW_END;
+
+        char buffer[8000];
         while (bytesToCopyRemaining > 0)
         {
             const auto bytesToRead = static_cast<ULONG>(std::min(bytesToCopyRemaining, static_cast<ULONGLONG>(sizeof(buffer))));
@@ -155,7 +180,13 @@ namespace streams
 
     STDMETHODIMP ReadStream::Clone(IStream** ppstm) noexcept
     {
-        if (ppstm != nullptr) { *ppstm = nullptr; }
-        return E_NOTIMPL; // limit access to one thread, also not supported by Windows Search
+        COM_CHECK_POINTER_AND_SET(ppstm, nullptr);
+        COM_NOTHROW_BEGIN;
+
+        // the clone shares the buffer, but starts at the current position and moves on its own
+        *ppstm = ReadStream::CreateComInstance<IStream>(PIMPL_(buffer), PIMPL_(position)).Detach();
+        return S_OK;
+
+        COM_NOTHROW_END;
     }
 }
@@ -25,13 +25,13 @@
 
 namespace streams
 {
-    class ReadStream; // provides an ::IStream reader for a FileBuffer
+    class ReadStream; // provides an ::IStream reader for a FileBuffer, clones are independent cursors over the same buffer that can be used from different threads
 
     /******************************************************************************/
 
     COM_CLASS_DECLARATION(ReadStream, (IStream),
 public:
-    explicit ReadStream(FileBuffer& buffer);
+    explicit ReadStream(FileBuffer& buffer, ULONGLONG position = 0);
 
     STDMETHOD(Read)(void* pv, ULONG cb, ULONG* pcbRead) noexcept override;
     STDMETHOD(Write)(const void* pv, ULONG cb, ULONG* pcbWritten) noexcept override;
@@ -0,0 +1,186 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SpillFile.hpp"
+
+#include "counters.hpp"
+#include "settings.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+namespace streams
+{
+    constexpr static const auto SpillGranularity = ULONGLONG(0x100000); // files grow in steps of one megabyte
+
+    struct PooledFile
+    {
+        win32::unique_handle_ptr fileHandle;
+        win32::unique_threadpool_io_ptr fileIo; // must be closed before the handle
+        win32::unique_handle_ptr fileMapping;
+        ULONGLONG capacity = 0;
+    };
+
+    static auto _poolMutex = std::mutex();
+    static auto _pool = std::vector<PooledFile>();
+    static auto _pooledBytes = ULONGLONG(0);
+
+    /******************************************************************************/
+
+    static VOID CALLBACK WriteCompleted(PTP_CALLBACK_INSTANCE, PVOID, PVOID overlapped, ULONG ioResult, ULONG_PTR numberOfBytesTransferred, PTP_IO) noexcept
+    {
+        static_cast<SpillWrite*>(reinterpret_cast<OVERLAPPED*>(overlapped))->Completed(ioResult, numberOfBytesTransferred);
+    }
+
+    static void TryCreateTempFile(const std::filesystem::path path, win32::unique_handle_ptr& handle)
+    {
+        const auto filePath = path / utils::get_temp_file_name();
+        handle.reset(::CreateFileW(filePath.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_NEW, FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE | FILE_FLAG_OVERLAPPED, nullptr));
+        if (handle.get() == INVALID_HANDLE_VALUE) { handle.release(); }
+    }
+
+    static PooledFile CreateSpillFile()
+    {
+        auto file = PooledFile();
+        const auto tempPath = utils::get_temp_path();
+        TryCreateTempFile(tempPath, file.fileHandle); // this will most likely fail under Windows Search since the default temp directory is not writable
+        if (!file.fileHandle)
+        {
+            const auto lastError = ::GetLastError();
+            const auto systemTempPath = utils::get_system_temp_path();
+            if (tempPath == systemTempPath) { WIN32_THROW(lastError); } // no point in trying the same path twice
+            TryCreateTempFile(systemTempPath, file.fileHandle);
+            if (!file.fileHandle) { WIN32_THROW(lastError); } // better throw the original error
+        }
+        file.fileIo.reset(::CreateThreadpoolIo(file.fileHandle.get(), WriteCompleted, nullptr, nullptr)); // a handle can only be bound once, so it stays with the file
+        WIN32_DO_OR_THROW(file.fileIo);
+        counters::increment(counters::counter::spill_files_created);
+        return file;
+    }
+
+    static std::optional<PooledFile> TakePooledFile(ULONGLONG size)
+    {
+        const auto lock = std::lock_guard(_poolMutex);
+        if (_pool.empty()) { return std::nullopt; }
+
+        // prefer the smallest file that fits, otherwise grow the largest one
+        auto best = _pool.end();
+        for (auto it = _pool.begin(); it != _pool.end(); ++it)
+        {
+            if (it->capacity >= size && (best == _pool.end() || it->capacity < best->capacity)) { best = it; }
+        }
+        if (best == _pool.end()) { best = std::max_element(_pool.begin(), _pool.end(), [](const PooledFile& a, const PooledFile& b) { return a.capacity < b.capacity; }); }
+        auto file = std::move(*best);
+        _pool.erase(best);
+        _pooledBytes -= file.capacity;
+        counters::decrement(counters::counter::spill_pool_bytes, file.capacity);
+        counters::increment(counters::counter::spill_files_reused);
+        return file;
+    }
+
+    static void ReturnPooledFile(PooledFile&& file) noexcept
+    {
+        if (!file.fileHandle || !file.fileIo || !file.fileMapping) { return; } // incomplete files are simply deleted
+        try
+        {
+            const auto lock = std::lock_guard(_poolMutex);
+            if (_pooledBytes + file.capacity > settings::spill_pool_size()) { return; } // the handles close and the file gets deleted
+            _pool.push_back(std::move(file));
+            _pooledBytes += _pool.back().capacity;
+            counters::increment(counters::counter::spill_pool_bytes, _pool.back().capacity);
+        }
+        catch (...) {} // same as above
+    }
+
+    /******************************************************************************/
+
+    CLASS_IMPLEMENTATION_UNIQUE(SpillFile,
+                                PIMPL_CONSTRUCTOR(PooledFile&& file) : file(std::move(file)) {}
+                                PIMPL_DECONSTRUCTOR() { ReturnPooledFile(std::move(file)); }
+public:
+    PooledFile file;
+    );
+
+    static PooledFile PrepareFile(ULONGLONG size)
+    {
+        auto pooledFile = TakePooledFile(size);
+        auto file = pooledFile ? std::move(*pooledFile) : CreateSpillFile();
+        if (file.capacity < size)
+        {
+            // the mapping has a fixed size, so drop it before growing the file
+            file.fileMapping.reset();
+            auto endOfFilePosition = LARGE_INTEGER();
+            endOfFilePosition.QuadPart = ((size + SpillGranularity - 1) / SpillGranularity) * SpillGranularity;
+            WIN32_DO_OR_THROW(::SetFilePointerEx(file.fileHandle.get(), endOfFilePosition, nullptr, FILE_BEGIN));
+            WIN32_DO_OR_THROW(::SetEndOfFile(file.fileHandle.get()));
+            WIN32_DO_OR_THROW(::SetFilePointerEx(file.fileHandle.get(), LARGE_INTEGER(), nullptr, FILE_BEGIN));
+            file.capacity = endOfFilePosition.QuadPart;
+        }
+        if (!file.fileMapping)
+        {
+            // map the whole file to allow simultaneous reading
+            file.fileMapping.reset(::CreateFileMappingW(file.fileHandle.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+            if (file.fileMapping.get() == INVALID_HANDLE_VALUE) { file.fileMapping.release(); }
+            WIN32_DO_OR_THROW(file.fileMapping);
+        }
+        return file;
+    }
+
+    SpillFile::SpillFile(ULONGLONG size) : PIMPL_INIT(PrepareFile(size)) {}
+
+    HANDLE SpillFile::GetFileHandle() const noexcept
+    {
+        return PIMPL_(file).fileHandle.get();
+    }
+
+    HANDLE SpillFile::GetFileMapping() const noexcept
+    {
+        return PIMPL_(file).fileMapping.get();
+    }
+
+    void SpillFile::Write(SpillWrite& write, ULONGLONG offset, const void* buffer, ULONG count) const
+    {
+        if (buffer == nullptr) { throw std::invalid_argument("buffer"); }
+
+        // the completion gets queued even if the write succeeds right away
+        write.Internal = 0;
+        write.InternalHigh = 0;
+        write.Offset = static_cast<DWORD>(offset);
+        write.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        write.hEvent = nullptr;
+        ::StartThreadpoolIo(PIMPL_(file).fileIo.get());
+        if (!::WriteFile(PIMPL_(file).fileHandle.get(), buffer, count, nullptr, &write))
+        {
+            const auto lastError = ::GetLastError();
+            if (lastError != ERROR_IO_PENDING)
+            {
+                ::CancelThreadpoolIo(PIMPL_(file).fileIo.get());
+                WIN32_THROW(lastError);
+            }
+        }
+    }
+
+    void SpillFile::WaitForWrites() const noexcept
+    {
+        ::WaitForThreadpoolIoCallbacks(PIMPL_(file).fileIo.get(), FALSE);
+    }
+}
@@ -0,0 +1,51 @@
+/*
+ * iFilter4Archives
+ * Copyright (C) 2019  Manuel Meitinger
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pimpl.hpp"
+#include "win32.hpp"
+
+namespace streams
+{
+    class SpillFile; // temporary file on loan from the process-wide spill pool, returned on destruction
+    struct SpillWrite; // overlapped write to a SpillFile, must stay alive until completed
+
+    /******************************************************************************/
+
+    struct SpillWrite : public OVERLAPPED
+    {
+        SpillWrite() noexcept : OVERLAPPED() {}
+        virtual ~SpillWrite() noexcept = default;
+
+        virtual void Completed(DWORD error, ULONG_PTR bytesWritten) noexcept = 0; // called from the thread pool
+    };
+
+    /******************************************************************************/
+
+    CLASS_DECLARATION_UNIQUE(SpillFile,
+public:
+    explicit SpillFile(ULONGLONG size); // reuses a pooled file if possible, its content is undefined
+
+    PROPERTY_READONLY(HANDLE, FileHandle, PIMPL_GETTER_ATTRIB);
+    PROPERTY_READONLY(HANDLE, FileMapping, PIMPL_GETTER_ATTRIB); // read-only mapping of at least the requested size
+
+    void Write(SpillWrite& write, ULONGLONG offset, const void* buffer, ULONG count) const; // calls Completed unless it throws
+    void WaitForWrites() const noexcept; // until all Completed calls have returned
+    );
+}